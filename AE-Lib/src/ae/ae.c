@@ -81,9 +81,15 @@ int ae_set_sys_info(RTX_SYS_INFO *sys_info)
         return RTX_ERR;
     }
 
+#ifndef ECE350_TLSF
     sys_info->mem_algo      = BUDDY;
+#else
+    sys_info->mem_algo      = TLSF;
+#endif
 #ifndef ECE350_P4
     sys_info->sched         = DEFAULT;
+#elif defined ECE350_RM_PS
+    sys_info->sched         = RM_PS;
 #else    
     sys_info->sched         = EDF;
 #endif    
@@ -0,0 +1,264 @@
+/*
+ ****************************************************************************
+ *
+ *                  UNIVERSITY OF WATERLOO ECE 350 RTOS LAB
+ *
+ *                     Copyright 2020-2022 Yiqing Huang
+ *                          All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  - Redistributions of source code must retain the above copyright
+ *    notice and the following disclaimer.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS AND CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************
+ */
+
+/**************************************************************************//**
+ * @file        ae_tasks101_G37.c
+ * @brief       P1 test suite 101 - buddy tail trimming on IRAM1
+ *
+ * @version     V1.2022.05
+ * @authors     Yiqing Huang
+ * @date        2022 May
+ *
+ * @note        Allocates a mixed-size trace and reports the bytes wasted by
+ *              rounding every request up to a power of two (the allocator
+ *              before tail trimming) against the bytes the pool actually
+ *              lost. Free space is measured by allocating MIN_BLK_SIZE blocks
+ *              until the pool runs out.
+ *
+ *****************************************************************************/
+
+#include "ae_tasks.h"
+#include "uart_polling.h"
+#include "printf.h"
+#include "ae.h"
+#include "ae_util.h"
+#include "ae_tasks_util.h"
+
+/*
+ *===========================================================================
+ *                             MACROS
+ *===========================================================================
+ */
+    
+#define NUM_TESTS       1       // number of tests
+#define NUM_INIT_TASKS  1       // number of tasks during initialization
+#define TRACE_LEN       10      // number of requests in the trace
+
+/*
+ *===========================================================================
+ *                             GLOBAL VARIABLES 
+ *===========================================================================
+ */
+
+TASK_INIT    g_init_tasks[NUM_INIT_TASKS];
+const char   PREFIX[]      = "G37-TS101";
+const char   PREFIX_LOG[]  = "G37-TS101-LOG ";
+const char   PREFIX_LOG2[] = "G37-TS101-LOG2";
+
+AE_XTEST     g_ae_xtest;                // test data, re-use for each test
+AE_CASE      g_ae_cases[NUM_TESTS];
+AE_CASE_TSK  g_tsk_cases[NUM_TESTS];
+
+// KCD message, mailbox and small stack sized requests, none a power of two
+const size_t g_trace[TRACE_LEN] = {
+    0x46, 0x280, 0x21, 0x90, 0x1A0, 0x2C, 0x110, 0x60, 0x38, 0xC8
+};
+
+void set_ae_init_tasks (TASK_INIT **pp_tasks, int *p_num)
+{
+    *p_num = NUM_INIT_TASKS;
+    *pp_tasks = g_init_tasks;
+    set_ae_tasks(*pp_tasks, *p_num);
+}
+
+// initial task configuration
+void set_ae_tasks(TASK_INIT *tasks, int num)
+{
+    for (int i = 0; i < num; i++ ) {                                                 
+        tasks[i].u_stack_size = PROC_STACK_SIZE;    
+        tasks[i].prio = HIGH + i;
+        tasks[i].priv = 1;
+    }
+    tasks[0].priv  = 1;
+    tasks[0].ptask = &priv_task1;
+    
+    init_ae_tsk_test();
+}
+
+void init_ae_tsk_test(void)
+{
+    g_ae_xtest.test_id = 0;
+    g_ae_xtest.index = 0;
+    g_ae_xtest.num_tests = NUM_TESTS;
+    g_ae_xtest.num_tests_run = 0;
+    
+    for ( int i = 0; i< NUM_TESTS; i++ ) {
+        g_tsk_cases[i].p_ae_case = &g_ae_cases[i];
+        g_tsk_cases[i].p_ae_case->results  = 0x0;
+        g_tsk_cases[i].p_ae_case->test_id  = i;
+        g_tsk_cases[i].p_ae_case->num_bits = 0;
+        g_tsk_cases[i].pos = 0;  // first avaiable slot to write exec seq tid
+        // *_expt fields are case specific, deligate to specific test case to initialize
+    }
+    printf("%s: START\r\n", PREFIX);
+}
+
+void update_ae_xtest(int test_id)
+{
+    g_ae_xtest.test_id = test_id;
+    g_ae_xtest.index = 0;
+    g_ae_xtest.num_tests_run++;
+}
+
+void gen_req0(int test_id)
+{
+    g_tsk_cases[test_id].p_ae_case->num_bits = 5;  
+    g_tsk_cases[test_id].p_ae_case->results = 0;
+    g_tsk_cases[test_id].p_ae_case->test_id = test_id;
+    g_tsk_cases[test_id].len = 16; // assign a value no greater than MAX_LEN_SEQ
+    g_tsk_cases[test_id].pos_expt = 0; // N/A for P1 tests
+       
+    update_ae_xtest(test_id);
+}
+
+/**
+ * @brief   bytes that can still be allocated from IRAM1
+ * @note    chains MIN_BLK_SIZE blocks through their first word until
+ *          mem_alloc fails, then frees the chain again
+ */
+U32 free_bytes(void)
+{
+    void **head = NULL;
+    U32 count = 0;
+    
+    for (void **p = mem_alloc(MIN_BLK_SIZE); p != NULL; p = mem_alloc(MIN_BLK_SIZE)) {
+        *p = head;
+        head = p;
+        count++;
+    }
+    while (head != NULL) {
+        void **next = *head;
+        mem_dealloc(head);
+        head = next;
+    }
+    return count * MIN_BLK_SIZE;
+}
+
+/**
+ * @brief   size of the power-of-two block a request used to occupy
+ */
+U32 pow2_block(size_t size)
+{
+    U32 block = MIN_BLK_SIZE;
+    while (block < size) {
+        block <<= 1;
+    }
+    return block;
+}
+
+/**
+ * @brief   allocates the trace and compares wasted bytes with and without tail trimming
+ */
+int test0_start(int test_id)
+{
+    static void *p[TRACE_LEN];
+    U8  *p_index    = &(g_ae_xtest.index);
+    int sub_result  = 0;
+    U32 requested   = 0;
+    U32 waste_pow2  = 0;
+    
+    gen_req0(test_id);
+    
+    int dump_before = mem_dump();
+    U32 free_before = free_bytes();
+    
+    //test 0-[0]
+    *p_index = 0;
+    sub_result = 1;
+    for ( int i = 0; i < TRACE_LEN; i++ ) {
+        p[i] = mem_alloc(g_trace[i]);
+        sub_result = (p[i] == NULL) ? 0 : sub_result;
+        requested  += g_trace[i];
+        waste_pow2 += pow2_block(g_trace[i]) - g_trace[i];
+    }
+    strcpy(g_ae_xtest.msg, "Allocating the mixed-size trace, check non-NULL returns");
+    process_sub_result(test_id, *p_index, sub_result);
+    
+    U32 used  = free_before - free_bytes();
+    U32 waste = used - requested;
+    printf("%s: requested = %u B, wasted before = %u B, wasted after = %u B\r\n",
+           PREFIX_LOG2, requested, waste_pow2, waste);
+    
+    //test 0-[1]
+    (*p_index)++;
+    strcpy(g_ae_xtest.msg, "Check tail trimming wastes less than power-of-two rounding");
+    sub_result = (waste < waste_pow2) ? 1 : 0;
+    process_sub_result(test_id, *p_index, sub_result);
+    
+    //test 0-[2]
+    (*p_index)++;
+    strcpy(g_ae_xtest.msg, "Check each request wastes less than one min block");
+    sub_result = (waste < TRACE_LEN * MIN_BLK_SIZE) ? 1 : 0;
+    process_sub_result(test_id, *p_index, sub_result);
+    
+    //test 0-[3]
+    (*p_index)++;
+    strcpy(g_ae_xtest.msg, "Writing a whole request stays inside its allocation");
+    for ( int i = 0; i < TRACE_LEN; i++ ) {
+        for ( int j = 0; j < g_trace[i]; j++ ) {
+            ((U8 *)p[i])[j] = (U8) i;
+        }
+    }
+    sub_result = 1;
+    for ( int i = 0; i < TRACE_LEN; i++ ) {
+        for ( int j = 0; j < g_trace[i]; j++ ) {
+            sub_result = (((U8 *)p[i])[j] != (U8) i) ? 0 : sub_result;
+        }
+    }
+    process_sub_result(test_id, *p_index, sub_result);
+    
+    //test 0-[4]
+    (*p_index)++;
+    for ( int i = 0; i < TRACE_LEN; i++ ) {
+        mem_dealloc(p[i]);
+    }
+    strcpy(g_ae_xtest.msg, "Freeing the trace re-merges the tails, check free bytes and mem_dump");
+    sub_result = (free_bytes() == free_before && mem_dump() == dump_before) ? 1 : 0;
+    process_sub_result(test_id, *p_index, sub_result);
+
+    return RTX_OK;
+}
+
+/**************************************************************************//**
+ * @brief       runs the tail trimming test on IRAM1
+ *****************************************************************************/
+
+void priv_task1(void)
+{
+    int test_id = 0;
+    
+    printf("%s: priv_task1: buddy tail trimming test on IRAM1\r\n", PREFIX_LOG2);
+    test0_start(test_id);
+    test_exit();
+}
+
+/*
+ *===========================================================================
+ *                             END OF FILE
+ *===========================================================================
+ */
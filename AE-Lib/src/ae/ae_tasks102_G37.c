@@ -0,0 +1,257 @@
+/*
+ ****************************************************************************
+ *
+ *                  UNIVERSITY OF WATERLOO ECE 350 RTOS LAB
+ *
+ *                     Copyright 2020-2022 Yiqing Huang
+ *                          All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  - Redistributions of source code must retain the above copyright
+ *    notice and the following disclaimer.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS AND CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************
+ */
+
+/**************************************************************************//**
+ * @file        ae_tasks102_G37.c
+ * @brief       P1 test suite 102 - mem_realloc on IRAM1
+ *
+ * @version     V1.2022.05
+ * @authors     Yiqing Huang
+ * @date        2022 May
+ *
+ * @note        Grows a block into its free buddy and shrinks it again, both
+ *              without moving it, then grows it past an allocated neighbour,
+ *              which has to move it. Contents must survive every step and
+ *              freeing everything must restore the pool.
+ *
+ *****************************************************************************/
+
+#include "ae_tasks.h"
+#include "uart_polling.h"
+#include "printf.h"
+#include "ae.h"
+#include "ae_util.h"
+#include "ae_tasks_util.h"
+
+/*
+ *===========================================================================
+ *                             MACROS
+ *===========================================================================
+ */
+    
+#define NUM_TESTS       1       // number of tests
+#define NUM_INIT_TASKS  1       // number of tasks during initialization
+
+/*
+ *===========================================================================
+ *                             GLOBAL VARIABLES 
+ *===========================================================================
+ */
+
+TASK_INIT    g_init_tasks[NUM_INIT_TASKS];
+const char   PREFIX[]      = "G37-TS102";
+const char   PREFIX_LOG[]  = "G37-TS102-LOG ";
+const char   PREFIX_LOG2[] = "G37-TS102-LOG2";
+
+AE_XTEST     g_ae_xtest;                // test data, re-use for each test
+AE_CASE      g_ae_cases[NUM_TESTS];
+AE_CASE_TSK  g_tsk_cases[NUM_TESTS];
+
+void set_ae_init_tasks (TASK_INIT **pp_tasks, int *p_num)
+{
+    *p_num = NUM_INIT_TASKS;
+    *pp_tasks = g_init_tasks;
+    set_ae_tasks(*pp_tasks, *p_num);
+}
+
+// initial task configuration
+void set_ae_tasks(TASK_INIT *tasks, int num)
+{
+    for (int i = 0; i < num; i++ ) {                                                 
+        tasks[i].u_stack_size = PROC_STACK_SIZE;    
+        tasks[i].prio = HIGH + i;
+        tasks[i].priv = 1;
+    }
+    tasks[0].priv  = 1;
+    tasks[0].ptask = &priv_task1;
+    
+    init_ae_tsk_test();
+}
+
+void init_ae_tsk_test(void)
+{
+    g_ae_xtest.test_id = 0;
+    g_ae_xtest.index = 0;
+    g_ae_xtest.num_tests = NUM_TESTS;
+    g_ae_xtest.num_tests_run = 0;
+    
+    for ( int i = 0; i< NUM_TESTS; i++ ) {
+        g_tsk_cases[i].p_ae_case = &g_ae_cases[i];
+        g_tsk_cases[i].p_ae_case->results  = 0x0;
+        g_tsk_cases[i].p_ae_case->test_id  = i;
+        g_tsk_cases[i].p_ae_case->num_bits = 0;
+        g_tsk_cases[i].pos = 0;  // first avaiable slot to write exec seq tid
+        // *_expt fields are case specific, deligate to specific test case to initialize
+    }
+    printf("%s: START\r\n", PREFIX);
+}
+
+void update_ae_xtest(int test_id)
+{
+    g_ae_xtest.test_id = test_id;
+    g_ae_xtest.index = 0;
+    g_ae_xtest.num_tests_run++;
+}
+
+void gen_req0(int test_id)
+{
+    g_tsk_cases[test_id].p_ae_case->num_bits = 5;  
+    g_tsk_cases[test_id].p_ae_case->results = 0;
+    g_tsk_cases[test_id].p_ae_case->test_id = test_id;
+    g_tsk_cases[test_id].len = 16; // assign a value no greater than MAX_LEN_SEQ
+    g_tsk_cases[test_id].pos_expt = 0; // N/A for P1 tests
+       
+    update_ae_xtest(test_id);
+}
+
+/**
+ * @brief   bytes that can still be allocated from IRAM1
+ * @note    chains MIN_BLK_SIZE blocks through their first word until
+ *          mem_alloc fails, then frees the chain again
+ */
+U32 free_bytes(void)
+{
+    void **head = NULL;
+    U32 count = 0;
+    
+    for (void **p = mem_alloc(MIN_BLK_SIZE); p != NULL; p = mem_alloc(MIN_BLK_SIZE)) {
+        *p = head;
+        head = p;
+        count++;
+    }
+    while (head != NULL) {
+        void **next = *head;
+        mem_dealloc(head);
+        head = next;
+    }
+    return count * MIN_BLK_SIZE;
+}
+
+/**
+ * @brief   fills len bytes with a pattern derived from seed
+ */
+void fill_bytes(U8 *p, U32 len, U8 seed)
+{
+    for ( U32 i = 0; i < len; i++ ) {
+        p[i] = (U8)(seed + i);
+    }
+}
+
+/**
+ * @brief   checks the pattern written by fill_bytes
+ */
+int check_bytes(U8 *p, U32 len, U8 seed)
+{
+    for ( U32 i = 0; i < len; i++ ) {
+        if ( p[i] != (U8)(seed + i) ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief   resizes a block in place and by moving, checking its contents each time
+ */
+int test0_start(int test_id)
+{
+    U8  *p_index    = &(g_ae_xtest.index);
+    int sub_result  = 0;
+    
+    gen_req0(test_id);
+    
+    int dump_before = mem_dump();
+    U32 free_before = free_bytes();
+    
+    //test 0-[0]
+    *p_index = 0;
+    U8 *p = mem_alloc(0x40);
+    fill_bytes(p, 0x40, 0x11);
+    U8 *q = mem_realloc(p, 0x80);
+    strcpy(g_ae_xtest.msg, "Growing a block into its free buddy keeps the address and contents");
+    sub_result = (p != NULL && q == p && check_bytes(q, 0x40, 0x11)) ? 1 : 0;
+    process_sub_result(test_id, *p_index, sub_result);
+    
+    //test 0-[1]
+    (*p_index)++;
+    fill_bytes(q, 0x80, 0x22);
+    U32 free_grown = free_bytes();
+    q = mem_realloc(p, 0x30);
+    strcpy(g_ae_xtest.msg, "Shrinking a block keeps the address and contents and frees the rest");
+    sub_result = (q == p && check_bytes(q, 0x30, 0x22) && free_bytes() == free_grown + 0x40) ? 1 : 0;
+    process_sub_result(test_id, *p_index, sub_result);
+    
+    //test 0-[2]
+    (*p_index)++;
+    // free_bytes may have left the tail of p in a magazine, so put it back
+    // on the pool's free list and take it from there, right after p
+    mem_realloc(p, 0x80);
+    mem_realloc(p, 0x30);
+    U8 *r = NULL;
+    mem_alloc_n(0x40, 1, (void **)&r);
+    q = mem_realloc(p, 0x100);
+    strcpy(g_ae_xtest.msg, "Growing past an allocated neighbour moves the block, check contents and old address");
+    sub_result = (q != NULL && q != p && check_bytes(q, 0x30, 0x22) && mem_dealloc(p) == RTX_ERR) ? 1 : 0;
+    process_sub_result(test_id, *p_index, sub_result);
+    
+    //test 0-[3]
+    (*p_index)++;
+    U8 *s = mem_realloc(NULL, 0x20);
+    strcpy(g_ae_xtest.msg, "mem_realloc(NULL, n) allocates and mem_realloc(ptr, 0) frees");
+    sub_result = (s != NULL && mem_realloc(s, 0) == NULL && mem_dealloc(s) == RTX_ERR) ? 1 : 0;
+    process_sub_result(test_id, *p_index, sub_result);
+    
+    //test 0-[4]
+    (*p_index)++;
+    mem_dealloc(q);
+    mem_dealloc(r);
+    strcpy(g_ae_xtest.msg, "Freeing everything restores the pool, check free bytes and mem_dump");
+    sub_result = (free_bytes() == free_before && mem_dump() == dump_before) ? 1 : 0;
+    process_sub_result(test_id, *p_index, sub_result);
+
+    return RTX_OK;
+}
+
+/**************************************************************************//**
+ * @brief       runs the mem_realloc test on IRAM1
+ *****************************************************************************/
+
+void priv_task1(void)
+{
+    int test_id = 0;
+    
+    printf("%s: priv_task1: mem_realloc test on IRAM1\r\n", PREFIX_LOG2);
+    test0_start(test_id);
+    test_exit();
+}
+
+/*
+ *===========================================================================
+ *                             END OF FILE
+ *===========================================================================
+ */
@@ -0,0 +1,243 @@
+/*
+ ****************************************************************************
+ *
+ *                  UNIVERSITY OF WATERLOO ECE 350 RTOS LAB
+ *
+ *                     Copyright 2020-2022 Yiqing Huang
+ *                          All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  - Redistributions of source code must retain the above copyright
+ *    notice and the following disclaimer.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS AND CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************
+ */
+
+
+/**************************************************************************//**
+ * @file        ae_tasks103_G37.c
+ * @brief       P1 test suite 103 - the librtx small-object heap
+ *
+ * @version     V1.2022.05
+ * @authors     Yiqing Huang
+ * @date        2022 May
+ *
+ * @note        Small objects of one class share a chunk aligned to
+ *              UHEAP_CHUNK_SIZE until it is full, bad pointers into a chunk
+ *              are refused, large requests go to the kernel heap, and
+ *              freeing everything restores the pool.
+ *
+ *****************************************************************************/
+
+#include "ae_tasks.h"
+#include "uart_polling.h"
+#include "printf.h"
+#include "ae.h"
+#include "ae_util.h"
+#include "ae_tasks_util.h"
+#include "uheap.h"
+
+/*
+ *===========================================================================
+ *                             MACROS
+ *===========================================================================
+ */
+    
+#define NUM_TESTS       1       // number of tests
+#define NUM_INIT_TASKS  1       // number of tasks during initialization
+#define CHUNK_OF(p)     ((U32)(p) & ~(UHEAP_CHUNK_SIZE - 1))
+
+/*
+ *===========================================================================
+ *                             GLOBAL VARIABLES 
+ *===========================================================================
+ */
+
+TASK_INIT    g_init_tasks[NUM_INIT_TASKS];
+const char   PREFIX[]      = "G37-TS103";
+const char   PREFIX_LOG[]  = "G37-TS103-LOG ";
+const char   PREFIX_LOG2[] = "G37-TS103-LOG2";
+
+AE_XTEST     g_ae_xtest;                // test data, re-use for each test
+AE_CASE      g_ae_cases[NUM_TESTS];
+AE_CASE_TSK  g_tsk_cases[NUM_TESTS];
+
+UHEAP        g_uheap;
+
+void set_ae_init_tasks (TASK_INIT **pp_tasks, int *p_num)
+{
+    *p_num = NUM_INIT_TASKS;
+    *pp_tasks = g_init_tasks;
+    set_ae_tasks(*pp_tasks, *p_num);
+}
+
+// initial task configuration
+void set_ae_tasks(TASK_INIT *tasks, int num)
+{
+    for (int i = 0; i < num; i++ ) {                                                 
+        tasks[i].u_stack_size = PROC_STACK_SIZE;    
+        tasks[i].prio = HIGH + i;
+        tasks[i].priv = 1;
+    }
+    tasks[0].priv  = 1;
+    tasks[0].ptask = &priv_task1;
+    
+    init_ae_tsk_test();
+}
+
+void init_ae_tsk_test(void)
+{
+    g_ae_xtest.test_id = 0;
+    g_ae_xtest.index = 0;
+    g_ae_xtest.num_tests = NUM_TESTS;
+    g_ae_xtest.num_tests_run = 0;
+    
+    for ( int i = 0; i< NUM_TESTS; i++ ) {
+        g_tsk_cases[i].p_ae_case = &g_ae_cases[i];
+        g_tsk_cases[i].p_ae_case->results  = 0x0;
+        g_tsk_cases[i].p_ae_case->test_id  = i;
+        g_tsk_cases[i].p_ae_case->num_bits = 0;
+        g_tsk_cases[i].pos = 0;  // first avaiable slot to write exec seq tid
+        // *_expt fields are case specific, deligate to specific test case to initialize
+    }
+    printf("%s: START\r\n", PREFIX);
+}
+
+void update_ae_xtest(int test_id)
+{
+    g_ae_xtest.test_id = test_id;
+    g_ae_xtest.index = 0;
+    g_ae_xtest.num_tests_run++;
+}
+
+void gen_req0(int test_id)
+{
+    g_tsk_cases[test_id].p_ae_case->num_bits = 5;  
+    g_tsk_cases[test_id].p_ae_case->results = 0;
+    g_tsk_cases[test_id].p_ae_case->test_id = test_id;
+    g_tsk_cases[test_id].len = 16; // assign a value no greater than MAX_LEN_SEQ
+    g_tsk_cases[test_id].pos_expt = 0; // N/A for P1 tests
+       
+    update_ae_xtest(test_id);
+}
+
+/**
+ * @brief   bytes that can still be allocated from IRAM1
+ * @note    chains MIN_BLK_SIZE blocks through their first word until
+ *          mem_alloc fails, then frees the chain again
+ */
+U32 free_bytes(void)
+{
+    void **head = NULL;
+    U32 count = 0;
+    
+    for (void **p = mem_alloc(MIN_BLK_SIZE); p != NULL; p = mem_alloc(MIN_BLK_SIZE)) {
+        *p = head;
+        head = p;
+        count++;
+    }
+    while (head != NULL) {
+        void **next = *head;
+        mem_dealloc(head);
+        head = next;
+    }
+    return count * MIN_BLK_SIZE;
+}
+
+/**
+ * @brief   allocates, frees and misuses objects of the user heap
+ */
+int test0_start(int test_id)
+{
+    U8  *p_index    = &(g_ae_xtest.index);
+    int sub_result  = 0;
+    void *obj[UHEAP_CHUNK_SIZE / UHEAP_MAX_OBJ + 1];
+    int n = 0;
+    
+    gen_req0(test_id);
+    
+    int dump_before = mem_dump();
+    U32 free_before = free_bytes();
+    uheap_init(&g_uheap);
+    
+    //test 0-[0]
+    *p_index = 0;
+    U8 *a = uheap_alloc(&g_uheap, 5);
+    U8 *b = uheap_alloc(&g_uheap, UHEAP_MIN_OBJ);
+    strcpy(g_ae_xtest.msg, "Two small objects of a class come from one aligned chunk, past its header");
+    sub_result = (a != NULL && b == a + UHEAP_MIN_OBJ && CHUNK_OF(a) == CHUNK_OF(b) && (U32)a != CHUNK_OF(a)) ? 1 : 0;
+    process_sub_result(test_id, *p_index, sub_result);
+    
+    //test 0-[1]
+    (*p_index)++;
+    obj[n] = uheap_alloc(&g_uheap, UHEAP_MAX_OBJ);
+    while (n < UHEAP_CHUNK_SIZE / UHEAP_MAX_OBJ && obj[n] != NULL && CHUNK_OF(obj[n]) == CHUNK_OF(obj[0])) {
+        obj[++n] = uheap_alloc(&g_uheap, UHEAP_MAX_OBJ);
+    }
+    strcpy(g_ae_xtest.msg, "A full chunk of UHEAP_MAX_OBJ objects is followed by a new chunk");
+    sub_result = (n > 0 && n < UHEAP_CHUNK_SIZE / UHEAP_MAX_OBJ && obj[n] != NULL && CHUNK_OF(obj[n]) != CHUNK_OF(obj[0])) ? 1 : 0;
+    process_sub_result(test_id, *p_index, sub_result);
+    
+    //test 0-[2]
+    (*p_index)++;
+    errno = 0;
+    int ret_header = uheap_free(&g_uheap, (void *)(CHUNK_OF(a) + 4));
+    int err_header = errno;
+    int ret_middle = uheap_free(&g_uheap, a + 1);
+    strcpy(g_ae_xtest.msg, "Freeing a chunk header or the middle of an object fails with EFAULT");
+    sub_result = (ret_header == RTX_ERR && err_header == EFAULT && ret_middle == RTX_ERR && errno == EFAULT) ? 1 : 0;
+    process_sub_result(test_id, *p_index, sub_result);
+    
+    //test 0-[3]
+    (*p_index)++;
+    U8 *big = uheap_alloc(&g_uheap, UHEAP_MAX_OBJ + 1);
+    int ret_big = uheap_free(&g_uheap, big);
+    strcpy(g_ae_xtest.msg, "An object larger than UHEAP_MAX_OBJ is a kernel heap block, check it is freed there");
+    sub_result = (big != NULL && ret_big == RTX_OK && mem_dealloc(big) == RTX_ERR) ? 1 : 0;
+    process_sub_result(test_id, *p_index, sub_result);
+    
+    //test 0-[4]
+    (*p_index)++;
+    int ret_val = uheap_free(&g_uheap, a) | uheap_free(&g_uheap, b);
+    for (int i = 0; i <= n; i++) {
+        ret_val |= uheap_free(&g_uheap, obj[i]);
+    }
+    uheap_destroy(&g_uheap);
+    strcpy(g_ae_xtest.msg, "Freeing every object and destroying the heap restores the pool, check free bytes and mem_dump");
+    sub_result = (ret_val == RTX_OK && free_bytes() == free_before && mem_dump() == dump_before) ? 1 : 0;
+    process_sub_result(test_id, *p_index, sub_result);
+
+    return RTX_OK;
+}
+
+/**************************************************************************//**
+ * @brief       runs the user heap test
+ *****************************************************************************/
+
+void priv_task1(void)
+{
+    int test_id = 0;
+    
+    printf("%s: priv_task1: user heap test\r\n", PREFIX_LOG2);
+    test0_start(test_id);
+    test_exit();
+}
+
+/*
+ *===========================================================================
+ *                             END OF FILE
+ *===========================================================================
+ */
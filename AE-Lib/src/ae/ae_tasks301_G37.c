@@ -0,0 +1,324 @@
+/*
+ ****************************************************************************
+ *
+ *                  UNIVERSITY OF WATERLOO ECE 350 RTOS LAB
+ *
+ *                     Copyright 2020-2022 Yiqing Huang
+ *                          All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  - Redistributions of source code must retain the above copyright
+ *    notice and the following disclaimer.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS AND CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************
+ */
+
+
+/**************************************************************************//**
+ * @file        ae_tasks301_G37.c
+ * @brief       P4 test suite 301 - EDF release order
+ *
+ * @version     V1.2022.05
+ * @authors     Yiqing Huang
+ * @date        2022 May
+ *
+ * @note        Build with ECE350_P4 so the kernel schedules by EDF.
+ *              task0, task1 and task2 become RT tasks A, B and C with
+ *              periods of 80, 20 and 50 ticks. task3 becomes RT task R
+ *              with the shortest period and, 155 ticks in, keeps the CPU
+ *              with the earliest deadline until A and B (released at 160)
+ *              and C (released at 200) are all ready. Once R exits they
+ *              must run by absolute deadline, B (180), A (240), C (250),
+ *              not in release order. B is already past its deadline when
+ *              it suspends, so it is released again at once and runs a
+ *              second time before A.
+ *
+ *****************************************************************************/
+
+#include "ae_tasks.h"
+#include "uart_polling.h"
+#include "printf.h"
+#include "ae.h"
+#include "ae_util.h"
+#include "ae_tasks_util.h"
+
+/*
+ *===========================================================================
+ *                             MACROS
+ *===========================================================================
+ */
+    
+#define NUM_TESTS       1       // number of tests
+#define NUM_INIT_TASKS  5       // number of tasks during initialization
+#define NUM_RT_TASKS    3       // A, B and C
+#define BUF_LEN         64      // checker mailbox size
+#define SEQ_LEN         4       // activations of A, B and C logged after the gate
+#define PERIOD_A        80      // periods in ticks
+#define PERIOD_B        20
+#define PERIOD_C        50
+#define PERIOD_R        5
+#define GATE_AT         31      // R's activation that starts the gate, 155 ticks in
+
+/*
+ *===========================================================================
+ *                             GLOBAL VARIABLES 
+ *===========================================================================
+ */
+
+TASK_INIT    g_init_tasks[NUM_INIT_TASKS];
+const char   PREFIX[]      = "G37-TS301";
+const char   PREFIX_LOG[]  = "G37-TS301-LOG ";
+const char   PREFIX_LOG2[] = "G37-TS301-LOG2";
+
+AE_XTEST     g_ae_xtest;                // test data, re-use for each test
+AE_CASE      g_ae_cases[NUM_TESTS];
+AE_CASE_TSK  g_tsk_cases[NUM_TESTS];
+
+task_t       g_tids[NUM_INIT_TASKS];    // A, B, C, R and the checker
+volatile int g_gate;                    // 1 while R holds the CPU, 2 once it has exited
+U8           g_buf1[BUF_LEN];
+U8           g_buf2[BUF_LEN];
+
+void set_ae_init_tasks (TASK_INIT **pp_tasks, int *p_num)
+{
+    *p_num = NUM_INIT_TASKS;
+    *pp_tasks = g_init_tasks;
+    set_ae_tasks(*pp_tasks, *p_num);
+}
+
+// initial task configuration
+void set_ae_tasks(TASK_INIT *tasks, int num)
+{
+    for (int i = 0; i < num; i++ ) {                                                 
+        tasks[i].u_stack_size = PROC_STACK_SIZE;    
+        tasks[i].prio = HIGH;
+        tasks[i].priv = 0;
+    }
+    tasks[0].ptask = &task0;
+    tasks[1].ptask = &task1;
+    tasks[2].ptask = &task2;
+    tasks[3].ptask = &task3;
+    tasks[4].ptask = &priv_task1;
+    tasks[4].prio  = LOW;       // runs once A, B, C and R are RT tasks
+    tasks[4].priv  = 1;
+    
+    init_ae_tsk_test();
+}
+
+void init_ae_tsk_test(void)
+{
+    g_ae_xtest.test_id = 0;
+    g_ae_xtest.index = 0;
+    g_ae_xtest.num_tests = NUM_TESTS;
+    g_ae_xtest.num_tests_run = 0;
+    
+    for ( int i = 0; i< NUM_TESTS; i++ ) {
+        g_tsk_cases[i].p_ae_case = &g_ae_cases[i];
+        g_tsk_cases[i].p_ae_case->results  = 0x0;
+        g_tsk_cases[i].p_ae_case->test_id  = i;
+        g_tsk_cases[i].p_ae_case->num_bits = 0;
+        g_tsk_cases[i].pos = 0;  // first avaiable slot to write exec seq tid
+        // *_expt fields are case specific, deligate to specific test case to initialize
+    }
+    printf("%s: START\r\n", PREFIX);
+}
+
+void update_ae_xtest(int test_id)
+{
+    g_ae_xtest.test_id = test_id;
+    g_ae_xtest.index = 0;
+    g_ae_xtest.num_tests_run++;
+}
+
+void gen_req0(int test_id)
+{
+    g_tsk_cases[test_id].p_ae_case->num_bits = 2;  
+    g_tsk_cases[test_id].p_ae_case->results = 0;
+    g_tsk_cases[test_id].p_ae_case->test_id = test_id;
+    g_tsk_cases[test_id].len = SEQ_LEN;
+    g_tsk_cases[test_id].pos_expt = SEQ_LEN;
+    
+    g_tsk_cases[test_id].seq_expt[0] = g_tids[1];
+    g_tsk_cases[test_id].seq_expt[1] = g_tids[1];
+    g_tsk_cases[test_id].seq_expt[2] = g_tids[0];
+    g_tsk_cases[test_id].seq_expt[3] = g_tids[2];
+       
+    update_ae_xtest(test_id);
+}
+
+/**
+ * @brief   logs an activation of the calling RT task after the gate. The
+ *          one that fills the log wakes the checker.
+ */
+int update_exec_seq(int test_id, task_t tid)
+{
+    U8 *p_pos = &g_tsk_cases[test_id].pos;
+    
+    if (g_gate != 2 || *p_pos >= SEQ_LEN) {
+        return RTX_OK;
+    }
+    g_tsk_cases[test_id].seq[(*p_pos)++] = tid;
+    if (*p_pos == SEQ_LEN) {
+        struct rtx_msg_hdr *ptr = (void *)g_buf1;
+        
+        ptr->length = sizeof(struct rtx_msg_hdr);
+        ptr->type = DEFAULT;
+        ptr->sender_tid = tid;
+        return send_msg_nb(g_tids[4], ptr);
+    }
+    return RTX_OK;
+}
+
+/**
+ * @brief   makes the caller a RT task with a period of ticks
+ */
+void rt_start(int index, U32 ticks)
+{
+    TIMEVAL tv;
+    
+    g_tids[index] = tsk_gettid();
+    tv.sec  = 0;
+    tv.usec = ticks * RTX_TICK_SIZE;
+    rt_tsk_set(&tv);
+}
+
+/**
+ * @brief   every period, log the activation and suspend
+ */
+void rt_loop(int index, U32 ticks)
+{
+    rt_start(index, ticks);
+    while (1) {
+        update_exec_seq(0, g_tids[index]);
+        rt_tsk_susp();
+    }
+}
+
+/**
+ * @brief   TRUE if every one of A, B and C is released and waiting to run
+ */
+BOOL rt_all_ready(void)
+{
+    RTX_TASK_INFO info;
+    
+    for (int i = 0; i < NUM_RT_TASKS; i++) {
+        if (tsk_get(g_tids[i], &info) != RTX_OK || info.state != READY) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/**
+ * @brief   checks the order A, B and C ran in after the gate
+ */
+int test0_start(int test_id)
+{
+    U8      *p_index    = &(g_ae_xtest.index);
+    int     sub_result  = 0;
+    task_t  *p_seq      = g_tsk_cases[test_id].seq;
+    task_t  *p_seq_expt = g_tsk_cases[test_id].seq_expt;
+    
+    gen_req0(test_id);
+    
+    for (int i = 0; i < SEQ_LEN; i++) {
+        printf("%s: seq[%d] = %u, expected %u\r\n", PREFIX_LOG2, i, p_seq[i], p_seq_expt[i]);
+    }
+    
+    //test 0-[0]
+    *p_index = 0;
+    strcpy(g_ae_xtest.msg, "Tasks released together run by absolute deadline B, A, C, not release order");
+    sub_result = (p_seq[0] == p_seq_expt[0] && p_seq[2] == p_seq_expt[2] && p_seq[3] == p_seq_expt[3]) ? 1 : 0;
+    process_sub_result(test_id, *p_index, sub_result);
+    
+    //test 0-[1]
+    (*p_index)++;
+    strcpy(g_ae_xtest.msg, "B suspends past its deadline, is released again at once and runs before A");
+    sub_result = (g_tsk_cases[test_id].pos == SEQ_LEN && p_seq[1] == p_seq_expt[1]) ? 1 : 0;
+    process_sub_result(test_id, *p_index, sub_result);
+    
+    return RTX_OK;
+}
+
+/**************************************************************************//**
+ * @brief       RT task A
+ *****************************************************************************/
+
+void task0(void)
+{
+    rt_loop(0, PERIOD_A);
+}
+
+/**************************************************************************//**
+ * @brief       RT task B
+ *****************************************************************************/
+
+void task1(void)
+{
+    rt_loop(1, PERIOD_B);
+}
+
+/**************************************************************************//**
+ * @brief       RT task C
+ *****************************************************************************/
+
+void task2(void)
+{
+    rt_loop(2, PERIOD_C);
+}
+
+/**************************************************************************//**
+ * @brief       RT task R, the gate
+ * @note        while it runs past its own deadline, R still has the
+ *              earliest one, so the tasks released meanwhile all wait
+ *****************************************************************************/
+
+void task3(void)
+{
+    rt_start(3, PERIOD_R);
+    for (int i = 0; i < GATE_AT; i++) {
+        rt_tsk_susp();
+    }
+    
+    g_gate = 1;
+    while (!rt_all_ready()) {
+        ;
+    }
+    g_gate = 2;
+    tsk_exit();
+}
+
+/**************************************************************************//**
+ * @brief       the checker, waits for the log to fill and checks it
+ *****************************************************************************/
+
+void priv_task1(void)
+{
+    int test_id = 0;
+    
+    g_tids[4] = tsk_gettid();
+    mbx_create(BUF_LEN);
+    printf("%s: priv_task1: EDF release order test\r\n", PREFIX_LOG2);
+    recv_msg(g_buf2, BUF_LEN);
+    test0_start(test_id);
+    test_exit();
+}
+
+/*
+ *===========================================================================
+ *                             END OF FILE
+ *===========================================================================
+ */
@@ -0,0 +1,354 @@
+/*
+ ****************************************************************************
+ *
+ *                  UNIVERSITY OF WATERLOO ECE 350 RTOS LAB
+ *
+ *                     Copyright 2020-2022 Yiqing Huang
+ *                          All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  - Redistributions of source code must retain the above copyright
+ *    notice and the following disclaimer.
+ *
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS AND CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ ****************************************************************************
+ */
+
+
+/**************************************************************************//**
+ * @file        ae_tasks302_G37.c
+ * @brief       P4 test suite 302 - RM_PS ordering and polling server budget
+ *
+ * @version     V1.2022.05
+ * @authors     Yiqing Huang
+ * @date        2022 May
+ *
+ * @note        Build with ECE350_P4 and ECE350_RM_PS so the kernel
+ *              schedules by RM_PS. task0 and task1 become RT tasks A and C
+ *              with periods of 80 and 50 ticks. task2 becomes RT task R
+ *              with the shortest period and, 155 ticks in, keeps the CPU
+ *              until A (released at 160, deadline 240) and C (released at
+ *              200, deadline 250) are both ready. Once R exits, C must run
+ *              first for its shorter period, where EDF would pick A.
+ *              The checker, a non-RT task, then spins for PS_WINDOW server
+ *              periods and times the runs it gets: none may be longer than
+ *              PS_BUDGET ticks, and they add up to about PS_BUDGET ticks
+ *              per PS_PERIOD.
+ *
+ *****************************************************************************/
+
+#include "ae_tasks.h"
+#include "uart_polling.h"
+#include "printf.h"
+#include "ae.h"
+#include "ae_util.h"
+#include "ae_tasks_util.h"
+#include "timer.h"
+
+/*
+ *===========================================================================
+ *                             MACROS
+ *===========================================================================
+ */
+    
+#define NUM_TESTS       1       // number of tests
+#define NUM_INIT_TASKS  4       // number of tasks during initialization
+#define NUM_RT_TASKS    2       // A and C
+#define BUF_LEN         64      // checker mailbox size
+#define SEQ_LEN         2       // activations of A and C logged after the gate
+#define PERIOD_A        80      // periods in ticks
+#define PERIOD_C        50
+#define PERIOD_R        5
+#define GATE_AT         31      // R's activation that starts the gate, 155 ticks in
+#define PS_WINDOW       10      // server periods the checker spins for
+#define GAP_US          (RTX_TICK_SIZE / 5)     // a longer gap between two reads means the checker was switched out
+
+/*
+ *===========================================================================
+ *                             GLOBAL VARIABLES 
+ *===========================================================================
+ */
+
+TASK_INIT    g_init_tasks[NUM_INIT_TASKS];
+const char   PREFIX[]      = "G37-TS302";
+const char   PREFIX_LOG[]  = "G37-TS302-LOG ";
+const char   PREFIX_LOG2[] = "G37-TS302-LOG2";
+
+AE_XTEST     g_ae_xtest;                // test data, re-use for each test
+AE_CASE      g_ae_cases[NUM_TESTS];
+AE_CASE_TSK  g_tsk_cases[NUM_TESTS];
+
+task_t       g_tids[NUM_INIT_TASKS];    // A, C, R and the checker
+volatile int g_gate;                    // 1 while R holds the CPU, 2 once it has exited
+U8           g_buf1[BUF_LEN];
+U8           g_buf2[BUF_LEN];
+
+void set_ae_init_tasks (TASK_INIT **pp_tasks, int *p_num)
+{
+    *p_num = NUM_INIT_TASKS;
+    *pp_tasks = g_init_tasks;
+    set_ae_tasks(*pp_tasks, *p_num);
+}
+
+// initial task configuration
+void set_ae_tasks(TASK_INIT *tasks, int num)
+{
+    for (int i = 0; i < num; i++ ) {                                                 
+        tasks[i].u_stack_size = PROC_STACK_SIZE;    
+        tasks[i].prio = HIGH;
+        tasks[i].priv = 0;
+    }
+    tasks[0].ptask = &task0;
+    tasks[1].ptask = &task1;
+    tasks[2].ptask = &task2;
+    tasks[3].ptask = &priv_task1;
+    tasks[3].prio  = LOW;       // runs once A, C and R are RT tasks
+    tasks[3].priv  = 1;         // reads TIMER1
+    
+    init_ae_tsk_test();
+}
+
+void init_ae_tsk_test(void)
+{
+    g_ae_xtest.test_id = 0;
+    g_ae_xtest.index = 0;
+    g_ae_xtest.num_tests = NUM_TESTS;
+    g_ae_xtest.num_tests_run = 0;
+    
+    for ( int i = 0; i< NUM_TESTS; i++ ) {
+        g_tsk_cases[i].p_ae_case = &g_ae_cases[i];
+        g_tsk_cases[i].p_ae_case->results  = 0x0;
+        g_tsk_cases[i].p_ae_case->test_id  = i;
+        g_tsk_cases[i].p_ae_case->num_bits = 0;
+        g_tsk_cases[i].pos = 0;  // first avaiable slot to write exec seq tid
+        // *_expt fields are case specific, deligate to specific test case to initialize
+    }
+    printf("%s: START\r\n", PREFIX);
+}
+
+void update_ae_xtest(int test_id)
+{
+    g_ae_xtest.test_id = test_id;
+    g_ae_xtest.index = 0;
+    g_ae_xtest.num_tests_run++;
+}
+
+void gen_req0(int test_id)
+{
+    g_tsk_cases[test_id].p_ae_case->num_bits = 3;  
+    g_tsk_cases[test_id].p_ae_case->results = 0;
+    g_tsk_cases[test_id].p_ae_case->test_id = test_id;
+    g_tsk_cases[test_id].len = SEQ_LEN;
+    g_tsk_cases[test_id].pos_expt = SEQ_LEN;
+    
+    g_tsk_cases[test_id].seq_expt[0] = g_tids[1];
+    g_tsk_cases[test_id].seq_expt[1] = g_tids[0];
+       
+    update_ae_xtest(test_id);
+}
+
+/**
+ * @brief   logs an activation of the calling RT task after the gate. The
+ *          one that fills the log wakes the checker.
+ */
+int update_exec_seq(int test_id, task_t tid)
+{
+    U8 *p_pos = &g_tsk_cases[test_id].pos;
+    
+    if (g_gate != 2 || *p_pos >= SEQ_LEN) {
+        return RTX_OK;
+    }
+    g_tsk_cases[test_id].seq[(*p_pos)++] = tid;
+    if (*p_pos == SEQ_LEN) {
+        struct rtx_msg_hdr *ptr = (void *)g_buf1;
+        
+        ptr->length = sizeof(struct rtx_msg_hdr);
+        ptr->type = DEFAULT;
+        ptr->sender_tid = tid;
+        return send_msg_nb(g_tids[3], ptr);
+    }
+    return RTX_OK;
+}
+
+/**
+ * @brief   makes the caller a RT task with a period of ticks
+ */
+void rt_start(int index, U32 ticks)
+{
+    TIMEVAL tv;
+    
+    g_tids[index] = tsk_gettid();
+    tv.sec  = 0;
+    tv.usec = ticks * RTX_TICK_SIZE;
+    rt_tsk_set(&tv);
+}
+
+/**
+ * @brief   every period, log the activation and suspend
+ */
+void rt_loop(int index, U32 ticks)
+{
+    rt_start(index, ticks);
+    while (1) {
+        update_exec_seq(0, g_tids[index]);
+        rt_tsk_susp();
+    }
+}
+
+/**
+ * @brief   TRUE if both A and C are released and waiting to run
+ */
+BOOL rt_all_ready(void)
+{
+    RTX_TASK_INFO info;
+    
+    for (int i = 0; i < NUM_RT_TASKS; i++) {
+        if (tsk_get(g_tids[i], &info) != RTX_OK || info.state != READY) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/**
+ * @brief   microseconds on the free running TIMER1
+ */
+U32 now_usec(void)
+{
+    TM_TICK tk;
+    
+    get_tick(&tk, TIMER1);
+    return tk.tc * 1000000 + tk.pc / 100;
+}
+
+/**
+ * @brief   checks the order A and C ran in after the gate, then times the
+ *          runs the polling server gives the caller
+ */
+int test0_start(int test_id)
+{
+    U8      *p_index    = &(g_ae_xtest.index);
+    int     sub_result  = 0;
+    task_t  *p_seq      = g_tsk_cases[test_id].seq;
+    task_t  *p_seq_expt = g_tsk_cases[test_id].seq_expt;
+    
+    gen_req0(test_id);
+    
+    //test 0-[0]
+    *p_index = 0;
+    strcpy(g_ae_xtest.msg, "Ready RT tasks run by period, C before A, although A has the earlier deadline");
+    sub_result = (g_tsk_cases[test_id].pos == SEQ_LEN && p_seq[0] == p_seq_expt[0] && p_seq[1] == p_seq_expt[1]) ? 1 : 0;
+    process_sub_result(test_id, *p_index, sub_result);
+    
+    // spin, a gap between two reads is time the server did not give us
+    U32 start   = now_usec();
+    U32 last    = start;
+    U32 run     = 0;
+    U32 longest = 0;
+    U32 total   = 0;
+    
+    while (last - start < PS_WINDOW * PS_PERIOD * RTX_TICK_SIZE) {
+        U32 now = now_usec();
+        
+        if (now - last > GAP_US) {
+            longest = (run > longest) ? run : longest;
+            run = 0;
+        } else {
+            run   += now - last;
+            total += now - last;
+        }
+        last = now;
+    }
+    longest = (run > longest) ? run : longest;
+    printf("%s: longest run %u usec, %u usec in %u server periods\r\n", PREFIX_LOG2, longest, total, PS_WINDOW);
+    
+    //test 0-[1]
+    (*p_index)++;
+    strcpy(g_ae_xtest.msg, "A non-RT task never runs longer than PS_BUDGET ticks at a time");
+    sub_result = (longest > 0 && longest <= PS_BUDGET * RTX_TICK_SIZE + GAP_US) ? 1 : 0;
+    process_sub_result(test_id, *p_index, sub_result);
+    
+    //test 0-[2]
+    (*p_index)++;
+    strcpy(g_ae_xtest.msg, "Non-RT tasks get about PS_BUDGET ticks in every PS_PERIOD");
+    sub_result = (total <= (PS_WINDOW + 1) * PS_BUDGET * RTX_TICK_SIZE && 
+                  total >= (PS_WINDOW - 1) * PS_BUDGET * RTX_TICK_SIZE / 2) ? 1 : 0;
+    process_sub_result(test_id, *p_index, sub_result);
+    
+    return RTX_OK;
+}
+
+/**************************************************************************//**
+ * @brief       RT task A
+ *****************************************************************************/
+
+void task0(void)
+{
+    rt_loop(0, PERIOD_A);
+}
+
+/**************************************************************************//**
+ * @brief       RT task C
+ *****************************************************************************/
+
+void task1(void)
+{
+    rt_loop(1, PERIOD_C);
+}
+
+/**************************************************************************//**
+ * @brief       RT task R, the gate
+ * @note        R has the shortest period, so the tasks released while it
+ *              runs all wait, and so does the polling server
+ *****************************************************************************/
+
+void task2(void)
+{
+    rt_start(2, PERIOD_R);
+    for (int i = 0; i < GATE_AT; i++) {
+        rt_tsk_susp();
+    }
+    
+    g_gate = 1;
+    while (!rt_all_ready()) {
+        ;
+    }
+    g_gate = 2;
+    tsk_exit();
+}
+
+/**************************************************************************//**
+ * @brief       the checker, a non-RT task that only runs on the server
+ * @note        it blocks until the log is full, so the server has nothing
+ *              to poll and cannot delay C before the gate
+ *****************************************************************************/
+
+void priv_task1(void)
+{
+    int test_id = 0;
+    
+    g_tids[3] = tsk_gettid();
+    mbx_create(BUF_LEN);
+    printf("%s: priv_task1: RM_PS order and server budget test\r\n", PREFIX_LOG2);
+    recv_msg(g_buf2, BUF_LEN);
+    test0_start(test_id);
+    test_exit();
+}
+
+/*
+ *===========================================================================
+ *                             END OF FILE
+ *===========================================================================
+ */
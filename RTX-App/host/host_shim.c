@@ -0,0 +1,87 @@
+/**************************************************************************//**
+ * @file        host_shim.c
+ * @brief       Host build support for running kernel code on a Linux PC
+ *
+ * @details     The memory manager works on the absolute RAM1_START/RAM2_START
+ *              addresses and casts pointers to 32-bit integers, so the two
+ *              pools are mapped at exactly those addresses. Both lie below
+ *              4 GB, which keeps the casts lossless on a 64-bit host.
+ *
+ *****************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "host_shim.h"
+
+/* the kernel headers are built with -Derrno=rtx_errno, see Makefile */
+int rtx_errno = 0;
+
+/* linker symbol behind RAM1_START_RT, the end of the OS image */
+unsigned int Image$$RW_IRAM1$$ZI$$Limit;
+
+/* lpc1768_mem.h values, repeated here to keep libc and RTX headers apart */
+#define HOST_RAM1_START 0x10007000UL
+#define HOST_RAM1_SIZE  0x1000UL
+#define HOST_RAM2_START 0x2007C000UL
+#define HOST_RAM2_SIZE  0x8000UL
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE MAP_FIXED
+#endif
+
+static int map_window(unsigned long start, unsigned long size)
+{
+    void *p = mmap((void *)start, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+    if (p == MAP_FAILED || p != (void *)start) {
+        fprintf(stderr, "host_ram_init: cannot map 0x%lx\n", start);
+        return -1;
+    }
+    return 0;
+}
+
+int host_ram_init(void)
+{
+    if (map_window(HOST_RAM1_START, HOST_RAM1_SIZE) != 0) {
+        return -1;
+    }
+    return map_window(HOST_RAM2_START, HOST_RAM2_SIZE);
+}
+
+unsigned long long host_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/* the kernel prints through tinyprintf, route it to stdout */
+void tfp_printf(char *fmt, ...)
+{
+    va_list va;
+
+    va_start(va, fmt);
+    vprintf(fmt, va);
+    va_end(va);
+}
+
+void tfp_sprintf(char *s, char *fmt, ...)
+{
+    va_list va;
+
+    va_start(va, fmt);
+    vsprintf(s, fmt, va);
+    va_end(va);
+}
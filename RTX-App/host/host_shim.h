@@ -0,0 +1,22 @@
+/**************************************************************************//**
+ * @file        host_shim.h
+ * @brief       Host build support for running kernel code on a Linux PC
+ *
+ * @note        Declared without any libc headers so that it can be included
+ *              next to the RTX headers (common.h has its own size_t).
+ *
+ *****************************************************************************/
+
+#ifndef HOST_SHIM_H_
+#define HOST_SHIM_H_
+
+/*
+ *===========================================================================
+ *                            FUNCTION PROTOTYPES
+ *===========================================================================
+ */
+
+int                 host_ram_init   (void);  /* map RAM1/RAM2 at their LPC1768 addresses */
+unsigned long long  host_cycles     (void);  /* free-running cycle counter */
+
+#endif // ! HOST_SHIM_H_
@@ -0,0 +1,19 @@
+/**************************************************************************//**
+ * @file        LPC17xx.h
+ * @brief       Host stand-in for the CMSIS device header
+ *
+ * @note        Only used by the host build in RTX-App/host. The kernel
+ *              sources compiled there do not touch any peripheral, so
+ *              nothing from the real device header is needed.
+ *
+ *****************************************************************************/
+
+#ifndef HOST_LPC17XX_H_
+#define HOST_LPC17XX_H_
+
+#include <stdint.h>
+
+/* armcc keyword the kernel uses where a copy per call site is wanted */
+#define __forceinline   __inline __attribute__((always_inline))
+
+#endif // ! HOST_LPC17XX_H_
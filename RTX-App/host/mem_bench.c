@@ -0,0 +1,217 @@
+/**************************************************************************//**
+ * @file        mem_bench.c
+ * @brief       Host microbenchmark: buddy alloc/free latency against tree height
+ *
+ * @details     For every level of both pools two cases are timed:
+ *              hit   - the free list at the target level already has a block,
+ *                      so the allocator only has to find and pop it. The block
+ *                      is then freed while its buddy is still allocated, so
+ *                      the free does not coalesce;
+ *              split - only the root is free, so the block is split down
+ *                      from level 0 to the target level, and freeing it
+ *                      coalesces all the way back up to the root.
+ *              Each case is repeated REPS times from the same pool state and
+ *              the minimum and average are reported in host cycles.
+ *              The magazine table times an alloc/free pair of each cached
+ *              size class through a task's magazine against the same pair
+ *              going straight to the IRAM1 buddy allocator, and the batch
+ *              table times BATCH blocks taken with one k_mpool_alloc_n
+ *              against BATCH separate k_mpool_alloc calls.
+ *              Absolute numbers are not Cortex-M3 cycles; the trend against
+ *              the level is what matters.
+ *
+ *****************************************************************************/
+
+#include "k_mem.h"
+#include "host_shim.h"
+
+#define REPS    2000
+#define BATCH   16
+
+static U32 pool_power(mpool_t mpid)
+{
+    return (mpid == MPID_IRAM1) ? MEM1_POWER : MEM2_POWER;
+}
+
+static U32 pool_height(mpool_t mpid)
+{
+    return (mpid == MPID_IRAM1) ? MEM1_HEIGHT : MEM2_HEIGHT;
+}
+
+typedef struct bench_result {
+    U32 alloc_min;
+    U32 alloc_avg;
+    U32 free_min;
+    U32 free_avg;
+} BENCH_RESULT;
+
+/**
+ * @brief   time one k_mpool_alloc and the matching k_mpool_dealloc of a level-sized block
+ * @param   hit     TRUE to pre-split so the target level free list is non-empty
+ */
+static int bench_level(mpool_t mpid, U32 level, BOOL hit, BENCH_RESULT *p_res)
+{
+    U32 size = 1U << (pool_power(mpid) - level);
+    unsigned long long alloc_total = 0;
+    unsigned long long free_total  = 0;
+
+    p_res->alloc_min = 0xFFFFFFFF;
+    p_res->free_min  = 0xFFFFFFFF;
+
+    for (int i = 0; i < REPS; i++) {
+        void *pre = NULL;
+        if (hit && level > 0) {
+            pre = k_mpool_alloc(mpid, size);    // leaves its buddy free at this level
+        }
+
+        unsigned long long t0 = host_cycles();
+        void *p = k_mpool_alloc(mpid, size);
+        unsigned long long t1 = host_cycles();
+
+        if (p == NULL) {
+            printf("bench_level: alloc failed, mpid = %d, level = %u\r\n", mpid, level);
+            return RTX_ERR;
+        }
+
+        unsigned long long t2 = host_cycles();
+        k_mpool_dealloc(mpid, p);
+        unsigned long long t3 = host_cycles();
+        k_mpool_dealloc(mpid, pre);
+
+        U32 dt = (U32)(t1 - t0);
+        alloc_total += dt;
+        p_res->alloc_min = (dt < p_res->alloc_min) ? dt : p_res->alloc_min;
+
+        dt = (U32)(t3 - t2);
+        free_total += dt;
+        p_res->free_min = (dt < p_res->free_min) ? dt : p_res->free_min;
+    }
+
+    p_res->alloc_avg = (U32)(alloc_total / REPS);
+    p_res->free_avg  = (U32)(free_total / REPS);
+    return RTX_OK;
+}
+
+static void bench_pool(mpool_t mpid)
+{
+    printf("\r\nmpid = %d, pool = 0x%x bytes, height = %u, cycles as min/avg\r\n",
+           mpid, 1U << pool_power(mpid), pool_height(mpid));
+    printf("level  block   alloc-hit    free-no-merge   alloc-split  free-merge\r\n");
+
+    for (U32 level = 0; level <= pool_height(mpid); level++) {
+        BENCH_RESULT hit, split;
+        if (bench_level(mpid, level, TRUE, &hit) != RTX_OK ||
+            bench_level(mpid, level, FALSE, &split) != RTX_OK) {
+            return;
+        }
+
+        printf("%5u  %5u  %5u/%-5u   %5u/%-5u   %5u/%-5u  %5u/%-5u\r\n", level,
+               1U << (pool_power(mpid) - level),
+               hit.alloc_min, hit.alloc_avg, hit.free_min, hit.free_avg,
+               split.alloc_min, split.alloc_avg, split.free_min, split.free_avg);
+    }
+}
+
+/**
+ * @brief   time REPS alloc/free pairs, through task 1's magazine or straight to the pool
+ */
+static void bench_pair(size_t size, BOOL mag, U32 *p_min, U32 *p_avg)
+{
+    unsigned long long total = 0;
+
+    *p_min = 0xFFFFFFFF;
+    for (int i = 0; i < REPS; i++) {
+        unsigned long long t0 = host_cycles();
+        void *p = mag ? k_mag_alloc(1, size) : k_mpool_alloc(MPID_IRAM1, size);
+        if (mag) {
+            k_mag_dealloc(1, p);
+        } else {
+            k_mpool_dealloc(MPID_IRAM1, p);
+        }
+        U32 dt = (U32)(host_cycles() - t0);
+
+        total += dt;
+        *p_min = (dt < *p_min) ? dt : *p_min;
+    }
+    *p_avg = (U32)(total / REPS);
+}
+
+static void bench_magazine(void)
+{
+    printf("\r\nIRAM1 alloc+free pair, cycles as min/avg\r\n");
+    printf("size   buddy         magazine\r\n");
+
+    for (U32 cls = 0; cls < MAG_CLASSES; cls++) {
+        U32 size = MIN_BLK_SIZE << cls;
+        U32 buddy_min, buddy_avg, mag_min, mag_avg;
+
+        bench_pair(size, FALSE, &buddy_min, &buddy_avg);
+        bench_pair(size, TRUE, &mag_min, &mag_avg);
+        printf("%4u   %5u/%-5u   %5u/%-5u\r\n", size, buddy_min, buddy_avg, mag_min, mag_avg);
+    }
+    k_mag_flush(1);
+}
+
+/**
+ * @brief   time REPS allocations of BATCH blocks from a fresh IRAM1, batched or one by one
+ */
+static void bench_batch(size_t size, BOOL batch, U32 *p_min, U32 *p_avg)
+{
+    void *blocks[BATCH];
+    unsigned long long total = 0;
+
+    *p_min = 0xFFFFFFFF;
+    for (int i = 0; i < REPS; i++) {
+        unsigned long long t0 = host_cycles();
+        if (batch) {
+            k_mpool_alloc_n(MPID_IRAM1, size, BATCH, blocks);
+        } else {
+            for (int j = 0; j < BATCH; j++) {
+                blocks[j] = k_mpool_alloc(MPID_IRAM1, size);
+            }
+        }
+        U32 dt = (U32)(host_cycles() - t0);
+        k_mpool_dealloc_n(MPID_IRAM1, blocks, BATCH);
+
+        total += dt;
+        *p_min = (dt < *p_min) ? dt : *p_min;
+    }
+    *p_avg = (U32)(total / REPS);
+}
+
+static void bench_batches(void)
+{
+    printf("\r\nIRAM1 allocation of %d blocks, cycles as min/avg\r\n", BATCH);
+    printf("size   single        batch\r\n");
+
+    for (U32 size = MIN_BLK_SIZE; size <= (MIN_BLK_SIZE << 2); size <<= 1) {
+        U32 single_min, single_avg, batch_min, batch_avg;
+
+        bench_batch(size, FALSE, &single_min, &single_avg);
+        bench_batch(size, TRUE, &batch_min, &batch_avg);
+        printf("%4u   %5u/%-5u   %5u/%-5u\r\n", size, single_min, single_avg, batch_min, batch_avg);
+    }
+}
+
+int main(void)
+{
+    if (host_ram_init() != 0) {
+        return 1;
+    }
+    if (k_mem_init(BUDDY) != RTX_OK) {
+        printf("k_mem_init failed\r\n");
+        return 1;
+    }
+
+    bench_pool(MPID_IRAM1);
+    bench_pool(MPID_IRAM2);
+    bench_magazine();
+    bench_batches();
+
+    // every block was returned, so both pools must have coalesced back to the root
+    if (k_mpool_dump(MPID_IRAM1) != 1 || k_mpool_dump(MPID_IRAM2) != 1) {
+        printf("pools did not coalesce back to a single block\r\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,359 @@
+/**************************************************************************//**
+ * @file        mem_replay.c
+ * @brief       Host trace replay: runs a recorded alloc/free stream against the allocator
+ *
+ * @details     Build the board image with MEM_TRACE set, run a suite such as
+ *              the AE memory tests and capture the UART output. Replaying
+ *              that log here issues the same requests to the same pools, in
+ *              the same order, and reports:
+ *                latency   p50/p90/p99/p99.9/max of each kind of call, in
+ *                          host cycles. With -n the trace is replayed that
+ *                          many times and each call keeps its fastest time;
+ *                ops/sec   calls per second of allocator time only, with the
+ *                          cycle counter calibrated against the wall clock;
+ *                usage     per pool: peak bytes in use, fragmentation when
+ *                          that peak was reached, worst fragmentation seen,
+ *                          and the state left at the end of the trace.
+ *              Recorded addresses are mapped to the addresses the replay got
+ *              back, so the trace stays consistent when the allocator under
+ *              test places blocks differently. A free of a block the replay
+ *              never got, because its allocation failed here or happened
+ *              before the capture started, is skipped and counted.
+ *
+ *              usage: mem_replay [-a buddy|tlsf] [-m] [-n runs] trace|- ...
+ *                -a    algorithm for the IRAM pools, buddy by default
+ *                -m    route IRAM1 calls through a task magazine, as the
+ *                      mem_alloc and mem_dealloc system calls do
+ *                -n    number of replays, 1 by default
+ *              A trace of - reads the log from stdin. With no trace, an
+ *              unknown option, an option missing its value or a value that
+ *              is not buddy/tlsf or a number, the usage line is printed.
+ *
+ *****************************************************************************/
+
+#include "k_mem.h"
+#include "host_shim.h"
+#include "trace.h"
+
+#define MAX_LIVE    ((RAM1_SIZE + RAM2_SIZE) / MIN_BLK_SIZE)
+#define MAX_TRACES  8
+#define REPLAY_TID  1           /* task whose magazine -m goes through */
+
+typedef struct live {
+    int     mpid;
+    U32     rec;                /* address in the trace */
+    void   *ptr;                /* address in the replay */
+} LIVE;
+
+typedef struct pool_usage {
+    U32     peak;
+    U32     frag_at_peak;
+    U32     worst_frag;
+} POOL_USAGE;
+
+typedef struct replay_counts {
+    U32     failed;             /* calls that failed in the replay */
+    U32     failed_rec;         /* calls that had failed on the board */
+    U32     skipped;            /* calls on blocks the replay does not have */
+} REPLAY_COUNTS;
+
+static LIVE         g_live[MAX_LIVE];
+static int          g_num_live;
+static POOL_USAGE   g_usage[NUM_MPOOLS];
+static BOOL         g_use_mag;
+
+void free(void *ptr);            /* libc, trace_load allocates with it */
+
+static int live_find(int mpid, U32 rec)
+{
+    for (int i = g_num_live - 1; i >= 0; i--) {
+        if (g_live[i].mpid == mpid && g_live[i].rec == rec) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void live_add(int mpid, U32 rec, void *ptr)
+{
+    if (g_num_live < MAX_LIVE) {
+        g_live[g_num_live].mpid = mpid;
+        g_live[g_num_live].rec  = rec;
+        g_live[g_num_live].ptr  = ptr;
+        g_num_live++;
+    }
+}
+
+static void live_remove(int idx)
+{
+    g_live[idx] = g_live[--g_num_live];
+}
+
+static void *replay_alloc(int mpid, size_t size)
+{
+    if (g_use_mag && mpid == MPID_IRAM1) {
+        return k_mag_alloc(REPLAY_TID, size);
+    }
+    return k_mpool_alloc(mpid, size);
+}
+
+static int replay_dealloc(int mpid, void *ptr)
+{
+    if (g_use_mag && mpid == MPID_IRAM1) {
+        return k_mag_dealloc(REPLAY_TID, ptr);
+    }
+    return k_mpool_dealloc(mpid, ptr);
+}
+
+static void sample_usage(int mpid)
+{
+    MEM_STATS stats;
+    POOL_USAGE *p_usage = &g_usage[mpid];
+
+    if (k_mpool_stats(mpid, &stats) != RTX_OK) {
+        return;
+    }
+    if (stats.in_use > p_usage->peak) {
+        p_usage->peak = stats.in_use;
+        p_usage->frag_at_peak = stats.frag;
+    }
+    if (stats.frag > p_usage->worst_frag) {
+        p_usage->worst_frag = stats.frag;
+    }
+}
+
+/**
+ * @brief   replays one op, returns the cycles the allocator call took or 0 if it was skipped
+ */
+static U32 replay_op(TRACE_OP *op, REPLAY_COUNTS *p_counts)
+{
+    unsigned long long t0;
+    U32 dt;
+    int idx = -1;
+
+    if (op->mpid < 0 || op->mpid >= NUM_MPOOLS || g_mpools[op->mpid].ctrl == NULL) {
+        p_counts->skipped++;
+        return 0;
+    }
+    if (op->kind != 'a' && op->ptr != 0) {
+        idx = live_find(op->mpid, op->ptr);
+        if (idx < 0) {
+            p_counts->skipped++;
+            return 0;
+        }
+    }
+
+    if (op->kind == 'a' || (op->kind == 'r' && op->ptr == 0)) {
+        U32 rec = (op->kind == 'a') ? op->ptr : op->new_ptr;
+
+        t0 = host_cycles();
+        void *ptr = replay_alloc(op->mpid, op->size);
+        dt = (U32)(host_cycles() - t0);
+
+        p_counts->failed_rec += (rec == 0);
+        if (ptr == NULL) {
+            p_counts->failed++;
+        } else if (rec != 0) {
+            live_add(op->mpid, rec, ptr);
+        } else {
+            replay_dealloc(op->mpid, ptr);  // the trace never frees it
+        }
+    } else if (op->kind == 'f') {
+        t0 = host_cycles();
+        replay_dealloc(op->mpid, g_live[idx].ptr);
+        dt = (U32)(host_cycles() - t0);
+        live_remove(idx);
+    } else {
+        t0 = host_cycles();
+        void *ptr = k_mpool_realloc(op->mpid, g_live[idx].ptr, op->size);
+        dt = (U32)(host_cycles() - t0);
+
+        if (op->size == 0) {
+            live_remove(idx);
+        } else {
+            p_counts->failed_rec += (op->new_ptr == 0);
+            if (ptr == NULL) {
+                p_counts->failed++;
+            } else {
+                g_live[idx].ptr = ptr;
+            }
+            if (op->new_ptr != 0) {
+                g_live[idx].rec = op->new_ptr;
+            }
+        }
+    }
+    return (dt == 0) ? 1 : dt;
+}
+
+/**
+ * @brief   replays the whole trace once from freshly initialised pools
+ * @param   sample  TRUE to collect pool usage after every op
+ */
+static int replay(TRACE_OP *ops, int count, int algo, BOOL sample, REPLAY_COUNTS *p_counts)
+{
+    if (k_mem_init(algo) != RTX_OK) {
+        printf("k_mem_init failed\r\n");
+        return RTX_ERR;
+    }
+    g_num_live = 0;
+
+    for (int i = 0; i < count; i++) {
+        U32 dt = replay_op(&ops[i], p_counts);
+
+        if (dt != 0 && (ops[i].cycles == 0 || dt < ops[i].cycles)) {
+            ops[i].cycles = dt;
+        }
+        if (sample && dt != 0) {
+            sample_usage(ops[i].mpid);
+        }
+    }
+    k_mag_flush(REPLAY_TID);
+    return RTX_OK;
+}
+
+static void print_latency(TRACE_OP *ops, int count, char kind, const char *name)
+{
+    TRACE_LAT lat;
+
+    trace_latency(ops, count, kind, &lat);
+    if (lat.count > 0) {
+        printf("%-8s %8d %7u %7u %7u %7u %7u\r\n", name, lat.count,
+               lat.p50, lat.p90, lat.p99, lat.p999, lat.max);
+    }
+}
+
+static const char *algo_name(int algo)
+{
+    switch (algo) {
+        case FIXED_POOL:    return "FIXED";
+        case BUDDY:         return "BUDDY";
+        case TLSF:          return "TLSF";
+        case STACK_POOL:    return "STACK";
+        default:            return "?";
+    }
+}
+
+static void print_usage(void)
+{
+    printf("\r\nmpid  algo      peak  frag@peak  worst-frag    in-use      free   largest\r\n");
+    for (int mpid = 0; mpid < NUM_MPOOLS; mpid++) {
+        MEM_STATS stats;
+
+        if (g_mpools[mpid].ctrl == NULL || k_mpool_stats(mpid, &stats) != RTX_OK) {
+            continue;
+        }
+        printf("%4d  %-5s  %7u  %8u%%  %9u%%  %8u  %8u  %8u\r\n", mpid, algo_name(g_mpools[mpid].algo),
+               g_usage[mpid].peak, g_usage[mpid].frag_at_peak, g_usage[mpid].worst_frag,
+               stats.in_use, stats.free, stats.largest_free);
+    }
+}
+
+static BOOL arg_is(const char *arg, const char *opt)
+{
+    while (*opt != '\0' && *arg == *opt) {
+        arg++;
+        opt++;
+    }
+    return *arg == *opt;
+}
+
+/*
+ * returns the decimal number arg spells, or -1 if it is not one
+ */
+static int arg_num(const char *arg)
+{
+    int n = 0;
+
+    if (*arg == '\0') {
+        return -1;
+    }
+    while (*arg >= '0' && *arg <= '9') {
+        n = n * 10 + (*arg++ - '0');
+    }
+    return (*arg == '\0') ? n : -1;
+}
+
+int main(int argc, char **argv)
+{
+    const char *paths[MAX_TRACES];
+    int num_paths = 0;
+    int algo = BUDDY;
+    int runs = 1;
+    BOOL bad = FALSE;
+
+    for (int i = 1; i < argc && !bad; i++) {
+        if (arg_is(argv[i], "-a") && i + 1 < argc) {
+            i++;
+            algo = arg_is(argv[i], "tlsf") ? TLSF : BUDDY;
+            bad = !arg_is(argv[i], "tlsf") && !arg_is(argv[i], "buddy");
+        } else if (arg_is(argv[i], "-m")) {
+            g_use_mag = TRUE;
+        } else if (arg_is(argv[i], "-n") && i + 1 < argc) {
+            runs = arg_num(argv[++i]);
+            bad = (runs < 0);
+            runs = (runs < 1) ? 1 : runs;
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            bad = TRUE;     // -h, a typo, or -a/-n with nothing after it
+        } else if (num_paths < MAX_TRACES) {
+            paths[num_paths++] = argv[i];
+        }
+    }
+    if (bad || num_paths == 0) {
+        printf("usage: mem_replay [-a buddy|tlsf] [-m] [-n runs] trace|- ...\r\n");
+        return 1;
+    }
+
+    if (host_ram_init() != 0) {
+        return 1;
+    }
+
+    for (int t = 0; t < num_paths; t++) {
+        TRACE_OP *ops = NULL;
+        REPLAY_COUNTS counts = {0, 0, 0};
+        int count = trace_load(paths[t], &ops);
+
+        if (count < 0) {
+            return 1;
+        }
+        for (int i = 0; i < count; i++) {
+            ops[i].cycles = 0;
+        }
+        for (int mpid = 0; mpid < NUM_MPOOLS; mpid++) {
+            g_usage[mpid].peak = g_usage[mpid].frag_at_peak = g_usage[mpid].worst_frag = 0;
+        }
+
+        double s0 = host_seconds();
+        unsigned long long c0 = host_cycles();
+        for (int run = 0; run < runs; run++) {
+            REPLAY_COUNTS run_counts = {0, 0, 0};
+            if (replay(ops, count, algo, run == 0, (run == 0) ? &counts : &run_counts) != RTX_OK) {
+                return 1;
+            }
+        }
+        double cycles_per_sec = (host_cycles() - c0) / (host_seconds() - s0);
+
+        unsigned long long total = 0;
+        int timed = 0;
+        for (int i = 0; i < count; i++) {
+            total += ops[i].cycles;
+            timed += (ops[i].cycles != 0);
+        }
+
+        printf("\r\n%s: %d ops, %s%s, fastest of %d run(s), cycles\r\n", paths[t], count,
+               algo_name(algo), g_use_mag ? " with magazines" : "", runs);
+        printf("op          count     p50     p90     p99   p99.9     max\r\n");
+        print_latency(ops, count, 'a', "alloc");
+        print_latency(ops, count, 'f', "free");
+        print_latency(ops, count, 'r', "realloc");
+        if (total > 0) {
+            printf("%u ops/s of allocator time\r\n", (U32)(timed * cycles_per_sec / total));
+        }
+        printf("failed %u (%u on the board), skipped %u\r\n",
+               counts.failed, counts.failed_rec, counts.skipped);
+
+        // the pools are left as the last run ended
+        print_usage();
+        free(ops);
+    }
+    return 0;
+}
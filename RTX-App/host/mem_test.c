@@ -0,0 +1,243 @@
+/**************************************************************************//**
+ * @file        mem_test.c
+ * @brief       Host unit tests for the memory pools made at runtime
+ *
+ * @details     Each test makes its pool with k_mpool_create over a block of
+ *              IRAM2 and checks the allocator through the k_mpool entry
+ *              points, looking at the pool's control block where the layout
+ *              matters. Every failed check is printed with its line and the
+ *              exit code is the number of failures, so `make test` fails if
+ *              any check does.
+ *
+ *              stack  - STACK_POOL: stacks carved from the top of the
+ *                       highest free extent that fits, merging with free
+ *                       neighbours on both sides, resize in place, and frees
+ *                       of a freed or overwritten header rejected.
+ *              fixed  - FIXED_POOL: every object handed out once until the
+ *                       pool runs dry, LIFO reuse, requests over obj_size
+ *                       refused, and interior, misaligned, outside and
+ *                       double frees rejected.
+ *
+ *****************************************************************************/
+
+#include "k_mem.h"
+#include "k_mem_stack.h"
+#include "k_mem_fixed.h"
+#include "host_shim.h"
+
+#define SPOOL_REGION    0x1000          /* bytes of IRAM2 the stack pool is made over */
+#define FPOOL_REGION    0x400           /* bytes of IRAM2 the fixed pool is made over */
+#define FPOOL_OBJ       20              /* object size asked for, the pool rounds it to 24 */
+#define FPOOL_MAX       64              /* more objects than FPOOL_REGION can hold */
+
+static int g_failed = 0;
+
+#define CHECK(cond)     check((cond), #cond, __LINE__)
+
+static void check(BOOL ok, const char *what, int line)
+{
+    if (!ok) {
+        printf("mem_test.c:%d: %s\r\n", line, what);
+        g_failed++;
+    }
+}
+
+/**
+ * @brief   make a pool of the given algorithm over a fresh block of IRAM2
+ */
+static mpool_t new_pool(int algo, U32 size)
+{
+    U32 region = (U32)k_mpool_alloc(MPID_IRAM2, size);
+
+    if (region == 0) {
+        return RTX_ERR;
+    }
+    return k_mpool_create(algo, region, region + size - 1);
+}
+
+/**
+ * @brief   number of free extents of a stack pool
+ */
+static U32 spool_extents(SPOOL *p_pool)
+{
+    U32 count = 0;
+
+    for (SBLOCK *ext = p_pool->free_head; ext != NULL; ext = ext->next) {
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief   number of objects on the free list of a fixed pool
+ */
+static U32 fpool_free(FPOOL *p_pool)
+{
+    U32 count = 0;
+
+    for (void **obj = p_pool->free_head; obj != NULL; obj = *obj) {
+        count++;
+    }
+    return count;
+}
+
+static void test_stack_pool(void)
+{
+    mpool_t mpid = new_pool(STACK_POOL, SPOOL_REGION);
+    U32 old = 0;
+
+    CHECK(mpid >= MAX_MPOOLS);
+    if (mpid < 0) {
+        return;
+    }
+    SPOOL *p_pool = g_mpools[mpid].ctrl;
+    U32 hdr = sizeof(SBLOCK);
+
+    // carved from the top, each stack right below the last, sizes only rounded to 8
+    U8 *a = k_mpool_alloc(mpid, 0x100);
+    U8 *b = k_mpool_alloc(mpid, 0x64);
+    U8 *c = k_mpool_alloc(mpid, 0x80);
+    CHECK(a != NULL && b != NULL && c != NULL);
+    CHECK((U32)a + 0x100 == p_pool->limit);
+    CHECK((U32)b + 0x68 == (U32)a - hdr);
+    CHECK((U32)c + 0x80 == (U32)b - hdr);
+    CHECK(spool_extents(p_pool) == 1 && (U32)p_pool->free_head == p_pool->base);
+    CHECK(p_pool->free_head->size == (U32)c - hdr - p_pool->base);
+    CHECK(k_mpool_alloc(mpid, p_pool->limit - p_pool->base) == NULL && errno == ENOMEM);
+
+    // not the start of a stack, or a header a stack overflow wrote over
+    CHECK(k_mpool_dealloc(mpid, b + 8) == RTX_ERR && errno == EFAULT);
+    CHECK(k_mpool_dealloc(mpid, b + 1) == RTX_ERR && errno == EFAULT);
+    SBLOCK *p_hdr = (SBLOCK *)b - 1;
+    SBLOCK saved = *p_hdr;
+    p_hdr->next = NULL;
+    CHECK(k_mpool_dealloc(mpid, b) == RTX_ERR && errno == EFAULT);
+    *p_hdr = saved;
+
+    // a merges with nothing, c with the free space below, b with both sides
+    CHECK(k_mpool_dealloc(mpid, a) == RTX_OK && spool_extents(p_pool) == 2);
+    CHECK(k_mpool_dealloc(mpid, c) == RTX_OK && spool_extents(p_pool) == 2);
+    CHECK(p_pool->free_head->size == (U32)b - hdr - p_pool->base);
+    CHECK(k_mpool_dealloc(mpid, b) == RTX_OK && spool_extents(p_pool) == 1);
+    CHECK(p_pool->free_head->size == p_pool->limit - p_pool->base);
+    CHECK(k_mpool_dealloc(mpid, b) == RTX_ERR && errno == EFAULT);
+    CHECK(k_mpool_dealloc(mpid, a) == RTX_ERR && errno == EFAULT);
+
+    // shrinking frees the tail, growing takes the extent above back in place
+    a = k_mpool_alloc(mpid, 0x200);
+    b = k_mpool_alloc(mpid, 0x100);
+    CHECK(k_spool_resize(mpid, b, 0x40, &old) == RTX_OK && old == 0x100);
+    CHECK(spool_extents(p_pool) == 2);
+    CHECK(k_mpool_realloc(mpid, b, 0xC0) == b && spool_extents(p_pool) == 2);
+    CHECK(k_mpool_realloc(mpid, b, 0x100) == b && spool_extents(p_pool) == 1);
+    CHECK((U32)b + 0x100 == (U32)a - hdr);
+    CHECK(k_spool_resize(mpid, b, 0x108, &old) == RTX_ERR && errno == ENOMEM);
+
+    // nothing free above the top stack, so it moves with its contents
+    for (U32 i = 0; i < 0x200; i++) {
+        a[i] = (U8)i;
+    }
+    U8 *moved = k_mpool_realloc(mpid, a, 0x300);
+    CHECK(moved != NULL && moved != a);
+    if (moved != NULL) {
+        BOOL same = TRUE;
+        for (U32 i = 0; i < 0x200; i++) {
+            same = same && moved[i] == (U8)i;
+        }
+        CHECK(same);
+    }
+    CHECK(k_mpool_dealloc(mpid, moved) == RTX_OK);
+    CHECK(k_mpool_dealloc(mpid, b) == RTX_OK);
+    CHECK(spool_extents(p_pool) == 1 && p_pool->free_head->size == p_pool->limit - p_pool->base);
+
+    // with a hole above the free space, a request that fits takes the top of the hole
+    a = k_mpool_alloc(mpid, 0x100);
+    b = k_mpool_alloc(mpid, 0x100);
+    c = k_mpool_alloc(mpid, 0x100);
+    CHECK(k_mpool_dealloc(mpid, b) == RTX_OK && spool_extents(p_pool) == 2);
+    b = k_mpool_alloc(mpid, 0x40);
+    CHECK((U32)b + 0x40 == (U32)a - hdr);
+    CHECK(k_mpool_dealloc(mpid, a) == RTX_OK);
+    CHECK(k_mpool_dealloc(mpid, c) == RTX_OK);
+    CHECK(k_mpool_dealloc(mpid, b) == RTX_OK);
+    CHECK(spool_extents(p_pool) == 1 && p_pool->free_head->size == p_pool->limit - p_pool->base);
+}
+
+static void test_fixed_pool(void)
+{
+    U32 region = (U32)k_mpool_alloc(MPID_IRAM2, FPOOL_REGION);
+    mpool_t mpid = k_mpool_create_fixed(region, region + FPOOL_REGION - 1, FPOOL_OBJ);
+    U8 *objs[FPOOL_MAX];
+    U32 n = 0;
+
+    CHECK(mpid >= MAX_MPOOLS);
+    if (mpid < 0) {
+        return;
+    }
+    FPOOL *p_pool = g_mpools[mpid].ctrl;
+    U32 size = p_pool->obj_size;
+    CHECK(size == 24);
+    CHECK(p_pool->num_objs > 0 && p_pool->num_objs < FPOOL_MAX);
+
+    // a range that cannot hold the control block, the bitmap and one object
+    U32 small = (U32)k_mpool_alloc(MPID_IRAM2, MIN_BLK_SIZE);
+    CHECK(k_mpool_create_fixed(small, small + MIN_BLK_SIZE - 1, MIN_BLK_SIZE) == RTX_ERR && errno == EINVAL);
+    k_mpool_dealloc(MPID_IRAM2, (void *)small);
+
+    // the free list is threaded in address order, one object after another
+    while (n < FPOOL_MAX && (objs[n] = k_mpool_alloc(mpid, (n & 1) ? size : 1)) != NULL) {
+        CHECK(objs[n] == p_pool->objs + n * size);
+        CHECK(((U32)objs[n] & 7) == 0 && (U32)objs[n] + size - 1 <= region + FPOOL_REGION - 1);
+        n++;
+    }
+    CHECK(n == p_pool->num_objs && p_pool->num_free == 0);
+    CHECK(errno == ENOMEM);
+    CHECK(g_mpools[mpid].stats.num_failed == 1);
+
+    // last in, first out: a freed object is the next one handed out
+    CHECK(k_mpool_dealloc(mpid, objs[3]) == RTX_OK && p_pool->num_free == 1);
+    CHECK(k_mpool_alloc(mpid, size + 1) == NULL && errno == EINVAL);
+    CHECK(k_mpool_alloc(mpid, size) == objs[3]);
+    CHECK(k_mpool_dealloc(mpid, objs[3]) == RTX_OK);
+    CHECK(k_mpool_dealloc(mpid, objs[5]) == RTX_OK);
+    CHECK(k_mpool_alloc(mpid, 8) == objs[5]);
+    CHECK(k_mpool_alloc(mpid, 8) == objs[3]);
+
+    // an object cannot grow, but a resize that fits keeps it where it is
+    CHECK(k_mpool_realloc(mpid, objs[3], size) == objs[3]);
+    CHECK(k_mpool_realloc(mpid, objs[3], size + 1) == NULL);
+
+    // only the first byte of an allocated object can be freed
+    CHECK(k_mpool_dealloc(mpid, objs[2] + 1) == RTX_ERR && errno == EFAULT);
+    CHECK(k_mpool_dealloc(mpid, objs[2] + 8) == RTX_ERR && errno == EFAULT);
+    CHECK(k_mpool_dealloc(mpid, objs[0] - 8) == RTX_ERR && errno == EFAULT);
+    CHECK(k_mpool_dealloc(mpid, objs[n - 1] + size) == RTX_ERR && errno == EFAULT);
+    CHECK(k_mpool_dealloc(mpid, objs[2]) == RTX_OK);
+    CHECK(k_mpool_dealloc(mpid, objs[2]) == RTX_ERR && errno == EFAULT);
+    CHECK(p_pool->num_free == 1);
+
+    for (U32 i = 0; i < n; i++) {
+        if (i != 2) {
+            CHECK(k_mpool_dealloc(mpid, objs[i]) == RTX_OK);
+        }
+    }
+    CHECK(p_pool->num_free == p_pool->num_objs);
+    CHECK(fpool_free(p_pool) == p_pool->num_objs);
+}
+
+int main(void)
+{
+    if (host_ram_init() != 0) {
+        return 1;
+    }
+    if (k_mem_init(BUDDY) != RTX_OK) {
+        printf("k_mem_init failed\r\n");
+        return 1;
+    }
+
+    test_stack_pool();
+    test_fixed_pool();
+
+    printf("mem_test: %d check(s) failed\r\n", g_failed);
+    return g_failed;
+}
@@ -0,0 +1,125 @@
+/**************************************************************************//**
+ * @file        trace.c
+ * @brief       Host trace replay: reading MEM_TRACE logs and latency percentiles
+ *
+ * @details     A trace is whatever the board printed with MEM_TRACE set, as
+ *              captured from the UART. Lines that do not start with "mt" are
+ *              test output and are skipped, so a whole AE run log can be
+ *              passed in unedited.
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+
+static int parse_line(const char *line, TRACE_OP *op)
+{
+    while (*line == ' ' || *line == '\t') {
+        line++;
+    }
+    if (strncmp(line, "mt ", 3) != 0) {
+        return 0;
+    }
+
+    memset(op, 0, sizeof(*op));
+    op->kind = line[3];
+    switch (op->kind) {
+    case 'a':
+        return sscanf(line + 4, "%d %u %x", &op->mpid, &op->size, &op->ptr) == 3;
+    case 'f':
+        return sscanf(line + 4, "%d %x", &op->mpid, &op->ptr) == 2;
+    case 'r':
+        return sscanf(line + 4, "%d %x %u %x", &op->mpid, &op->ptr, &op->size, &op->new_ptr) == 4;
+    default:
+        return 0;
+    }
+}
+
+int trace_load(const char *path, TRACE_OP **p_ops)
+{
+    FILE *fp = (path == NULL || strcmp(path, "-") == 0) ? stdin : fopen(path, "r");
+    TRACE_OP *ops = NULL;
+    int count = 0;
+    int cap = 0;
+    char line[256];
+
+    if (fp == NULL) {
+        fprintf(stderr, "trace_load: cannot open %s\n", path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (count == cap) {
+            cap = (cap == 0) ? 1024 : cap * 2;
+            TRACE_OP *grown = realloc(ops, cap * sizeof(TRACE_OP));
+            if (grown == NULL) {
+                free(ops);
+                count = -1;
+                break;
+            }
+            ops = grown;
+        }
+        count += parse_line(line, &ops[count]);
+    }
+
+    if (fp != stdin) {
+        fclose(fp);
+    }
+    *p_ops = ops;
+    return count;
+}
+
+static int cmp_uint(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a;
+    unsigned int y = *(const unsigned int *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* nearest-rank percentile of sorted samples, permille in [1, 1000] */
+static unsigned int rank(const unsigned int *sorted, int count, int permille)
+{
+    long idx = ((long)count * permille + 999) / 1000 - 1;
+
+    return sorted[(idx < 0) ? 0 : idx];
+}
+
+void trace_latency(const TRACE_OP *ops, int count, char kind, TRACE_LAT *out)
+{
+    unsigned int *samples = malloc((count > 0 ? count : 1) * sizeof(unsigned int));
+    int n = 0;
+
+    memset(out, 0, sizeof(*out));
+    if (samples == NULL) {
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        if (ops[i].kind == kind && ops[i].cycles != 0) {
+            samples[n++] = ops[i].cycles;
+        }
+    }
+
+    if (n > 0) {
+        qsort(samples, n, sizeof(unsigned int), cmp_uint);
+        out->count = n;
+        out->p50   = rank(samples, n, 500);
+        out->p90   = rank(samples, n, 900);
+        out->p99   = rank(samples, n, 990);
+        out->p999  = rank(samples, n, 999);
+        out->max   = samples[n - 1];
+    }
+    free(samples);
+}
+
+double host_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
@@ -0,0 +1,48 @@
+/**************************************************************************//**
+ * @file        trace.h
+ * @brief       Host trace replay: reading MEM_TRACE logs and latency percentiles
+ *
+ * @note        Declared without any libc or RTX headers so that it can be
+ *              included from either side, like host_shim.h.
+ *
+ *****************************************************************************/
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+/*
+ *===========================================================================
+ *                             TYPEDEFS
+ *===========================================================================
+ */
+
+/* one "mt" line of a MEM_TRACE log, see k_mem.c */
+typedef struct trace_op {
+    char            kind;       /* 'a' alloc, 'f' free or 'r' realloc */
+    int             mpid;
+    unsigned int    size;       /* requested bytes, unused for 'f' */
+    unsigned int    ptr;        /* recorded address: result of 'a', block of 'f' and 'r' */
+    unsigned int    new_ptr;    /* recorded result of 'r' */
+    unsigned int    cycles;     /* filled in by the replay */
+} TRACE_OP;
+
+typedef struct trace_lat {
+    int             count;
+    unsigned int    p50;
+    unsigned int    p90;
+    unsigned int    p99;
+    unsigned int    p999;
+    unsigned int    max;
+} TRACE_LAT;
+
+/*
+ *===========================================================================
+ *                            FUNCTION PROTOTYPES
+ *===========================================================================
+ */
+
+int     trace_load      (const char *path, TRACE_OP **p_ops);   /* number of ops read, -1 if error */
+void    trace_latency   (const TRACE_OP *ops, int count, char kind, TRACE_LAT *out);
+double  host_seconds    (void);                                 /* monotonic wall clock */
+
+#endif // ! TRACE_H_
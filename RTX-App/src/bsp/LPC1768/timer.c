@@ -42,6 +42,8 @@
 #define BIT(X) ( 1UL << (X) )
 
 volatile uint32_t g_timer_count = 0; // increment every 500 us
+volatile uint8_t  g_tick_idle = 0;   // MR0 is stretched past one tick, TICKLESS_IDLE only
+static   uint32_t g_tick_skew = 0;   // TC counts already past the tick grid when the stretch began
 
 /**
  * @brief: initialize timer IRQ. Only timer 0 is supported
@@ -128,17 +130,35 @@ uint32_t timer_irq_init(uint8_t n_timer)
  * @brief: use CMSIS ISR for TIMER0 IRQ Handler
  */
  
+#if SHARED_K_STACK
+void k_timer0_handler(void)
+#else
 void TIMER0_IRQHandler(void)
+#endif
 {
     /* ack inttrupt, see section  21.6.1 on pg 493 of LPC17XX_UM */
     LPC_TIM0->IR = BIT(0);
-		g_timer_count++;
+		U32 ticks = 1;
+		if (g_tick_idle) {
+			// slept through every tick up to the match, see timer_idle_enter
+			ticks = (LPC_TIM0->MR0 + 1 - g_tick_skew) >> 1;
+			// TC sits on the old MR0 until the next count resets it, move it
+			// to the new match or it counts on past MR0 = 1 until it wraps
+			if (LPC_TIM0->TC > 1) {
+				LPC_TIM0->TC = 1;
+			}
+			LPC_TIM0->MR0 = 1;
+			g_tick_idle = 0;
+		}
+		g_timer_count += ticks;
 	
+		BOOL resched = FALSE;
 		if (!empty(&timeout_list)) {
 			TCB* p_tcb = (TCB *)timeout_list.head;
-			p_tcb->timeout--;
+			p_tcb->timeout -= ticks;
 			
-			while (p_tcb->timeout == 0) {
+			// release every task whose timeout is up
+			while (p_tcb != NULL && p_tcb->timeout == 0) {
 				pop_front(&timeout_list);
 				
 				p_tcb->state = READY;
@@ -146,20 +166,97 @@ void TIMER0_IRQHandler(void)
 				p_tcb->timeout = p_tcb->release_time + p_tcb->deadline;
 				
 				rt_queue_add(p_tcb);
-				
-				// If any others are at timeout, repeat
-				if (!empty(&timeout_list)) {
-					p_tcb = (TCB *)timeout_list.head;
-					if (p_tcb->timeout == 0) {
-						continue;
-					}
-				}
-
-				k_tsk_run_new(INVOLUNTARY);
+				resched = TRUE;
+				p_tcb = (TCB *)timeout_list.head;
 			}
 		}
+		
+		// after the releases, so a server parked here sees timeout_list up to date
+		if (k_ps_charge(ticks)) {
+			resched = TRUE;
+		}
+		if (resched) {
+			k_tsk_run_new(INVOLUNTARY);
+		}
+}
+
+
+/**
+ * @brief: stretch TIMER0 so its next interrupt is the next timeout_list expiry.
+ *         TC runs 0, 1, 0, 1... with one tick per match at TC = 1. TC is
+ *         sampled rather than reset so the tick grid does not shift: from
+ *         TC = 0 the n-th tick is at 2n - 1, from TC = 1 (the tick ISR has
+ *         just run) TC goes on to 2 and the n-th tick is at 2n + 1.
+ *         Must be called with TIMER0 and UART0 interrupts held off.
+ * @return 1 if the tick is stopped, 0 if the next expiry is a tick away
+ */
+int timer_idle_enter(void)
+{
+    U32 n = 0x7FFFFFFE;             // nothing to wake up for, sleep as long as MR0 allows
+    U32 tc;
+
+    if (!empty(&timeout_list)) {
+        n = ((TCB *)timeout_list.head)->timeout;
+    }
+    if (n <= 1 || (LPC_TIM0->IR & BIT(0))) {
+        return 0;
+    }
+    tc = LPC_TIM0->TC;
+    if (tc > 1) {
+        return 0;
+    }
+    g_tick_skew = tc << 1;
+    LPC_TIM0->MR0 = 2 * n - 1 + g_tick_skew;
+
+    /* TC moved on before MR0 was written: it matched at 1 or was reset to 0,
+       either way the sample is stale, put the 500 us tick back */
+    if ((LPC_TIM0->IR & BIT(0)) || LPC_TIM0->TC < tc) {
+        LPC_TIM0->MR0 = 1;
+        return 0;
+    }
+    g_tick_idle = 1;
+    return 1;
 }
 
+/**
+ * @brief: bring the tick back after an early wake-up, called before any
+ *         task can read g_timer_count. The ticks slept so far are added
+ *         now; if the match is already pending its last tick is left to
+ *         the TIMER0 ISR. TC is put back on the same phase of the tick
+ *         before MR0 drops to 1, so it is never left past MR0.
+ */
+void timer_idle_exit(void)
+{
+    U32 ticks;
+    U32 full;
+
+    if (!g_tick_idle) {
+        return;
+    }
+    full = (LPC_TIM0->MR0 + 1 - g_tick_skew) >> 1;
+    if (LPC_TIM0->IR & BIT(0)) {
+        if (LPC_TIM0->TC > 1) {
+            LPC_TIM0->TC = 1;       // still on the old match, as in the ISR
+        }
+        LPC_TIM0->MR0 = 1;
+        ticks = full - 1;
+    } else {
+        U32 tc = LPC_TIM0->TC;
+        LPC_TIM0->TC = tc & 1;      // same phase within the tick
+        LPC_TIM0->MR0 = 1;
+        if (LPC_TIM0->IR & BIT(0)) {
+            ticks = full - 1;       // matched between the two reads
+        } else {
+            ticks = (tc + 1 - g_tick_skew) >> 1;
+        }
+    }
+    g_tick_idle = 0;
+
+    g_timer_count += ticks;
+    if (!empty(&timeout_list)) {
+        ((TCB *)timeout_list.head)->timeout -= ticks;
+    }
+}
 
 /**************************************************************************//**
  * @brief       Setting up Timer1&2 as free-running counter. No interrupt is fired.
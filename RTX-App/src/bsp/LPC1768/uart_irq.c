@@ -50,7 +50,7 @@ int uart_irq_init(int n_uart) {
 
     // Mailbox init ----------------------------------------------
   	uart_mb.space = UART_MBX_SIZE;
-		uart_mb.buf_start = k_mpool_alloc(MPID_IRAM2, UART_MBX_SIZE);
+		uart_mb.buf_start = k_mpool_alloc(g_mbx_mpid, UART_MBX_SIZE);
 		
 		if (uart_mb.buf_start == NULL) {
 			return RTX_ERR;
@@ -197,11 +197,18 @@ int uart_irq_init(int n_uart) {
  * @brief: CMSIS ISR for UART0 IRQ Handler
  */
 
+#if SHARED_K_STACK
+void k_uart0_handler(void)
+#else
 void UART0_IRQHandler(void)
+#endif
 {
     uint8_t IIR_IntId;        /* Interrupt ID from IIR */          
     LPC_UART_TypeDef *pUart = (LPC_UART_TypeDef *)LPC_UART0;
 
+#if TICKLESS_IDLE
+    timer_idle_exit();        /* the null task may have stopped the tick */
+#endif
     /* Reading IIR automatically acknowledges the interrupt */
     IIR_IntId = (pUart->IIR) >> 1 ; /* skip pending bit in IIR */ 
     if (IIR_IntId & IIR_RDA) { /* Receive Data Avaialbe */
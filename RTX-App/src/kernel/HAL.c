@@ -56,18 +56,102 @@ SVC_RTE
     ALIGN
 }
 
+#if SHARED_K_STACK
+void k_svc_handler(void);               // the SVC body below
+
+/**************************************************************************//**
+ * @brief   	common entry and exit of every trap into the kernel when all
+ *              tasks share one kernel stack
+ * @param       R12 the C handler to run
+ * @details     On entry from thread mode the thread's R4-R11 are saved just
+ *              below its exception frame and gp_current_task->u_sp points at
+ *              them, so nothing of the task is left on the MSP stack. On exit
+ *              any continuations are run and the context of gp_current_task,
+ *              which may be another task now, is loaded from its user stack.
+ *              A trap taken from handler mode only calls its handler, the
+ *              outermost trap does the switch.
+ *****************************************************************************/
+__asm void k_trap(void)
+{
+        PRESERVE8
+        EXPORT  K_TRAP
+        EXPORT  K_SWITCH_IN
+K_TRAP
+        MVN     R0, #:NOT:0xFFFFFFFD
+        CMP     LR, R0
+        BNE     K_TRAP_NESTED
+        MRS     R0, PSP
+        STMDB   R0!, {R4-R11}               // thread R4-R11 below the exception frame
+        LDR     R1, =__cpp(&gp_current_task)
+        LDR     R1, [R1]
+        CBZ     R1, K_TRAP_CALL             // rtx_init, no task yet
+        STR     R0, [R1, #TCB_USP_OFFSET]
+K_TRAP_CALL
+        PUSH    {R4, LR}
+        BLX     R12
+        LDR     R1, =__cpp(&gp_current_task)
+        LDR     R1, [R1]
+        CBZ     R1, K_TRAP_RET              // rtx_init failed, back to main
+        BL      __cpp(k_tsk_resume)
+        POP     {R4, LR}
+        LDR     R1, =__cpp(&gp_current_task)
+        LDR     R1, [R1]
+K_SWITCH_IN
+        LDR     R0, [R1, #TCB_USP_OFFSET]
+        LDMIA   R0!, {R4-R11}
+        MSR     PSP, R0
+        LDRB    R2, [R1, #TCB_PRIV_OFFSET]
+        EOR     R2, R2, #3                  // CONTROL: PSP, unprivileged unless priv
+        MSR     CONTROL, R2
+        ISB
+        BX      LR
+K_TRAP_RET
+        POP     {R4, PC}
+K_TRAP_NESTED
+        PUSH    {R4, LR}
+        BLX     R12
+        POP     {R4, PC}
+}
+
+__asm void SVC_Handler(void)
+{
+        PRESERVE8
+        LDR     R12, =__cpp(k_svc_handler)
+        B       K_TRAP
+}
+
+__asm void TIMER0_IRQHandler(void)
+{
+        PRESERVE8
+        LDR     R12, =__cpp(k_timer0_handler)
+        B       K_TRAP
+}
+
+__asm void UART0_IRQHandler(void)
+{
+        PRESERVE8
+        LDR     R12, =__cpp(k_uart0_handler)
+        B       K_TRAP
+}
+#endif
+
 /**************************************************************************//**
  * @brief   	SVC Handler
  * @pre         PSP is used in thread mode before entering SVC Handler
  *              SVC_Handler is configured as the highest interrupt priority
  *****************************************************************************/
 
+#if SHARED_K_STACK
+void k_svc_handler(void)
+#else
 void SVC_Handler(void)
+#endif
 {
     
     U8   svc_number;
     U32  ret  = RTX_OK;                 // default return value of a function
     U32 *args = (U32 *) __get_PSP();    // read PSP to get stacked args
+    TCB *p_caller = gp_current_task;
     
     svc_number = ((S8 *) args[6])[-2];  // Memory[(Stacked PC) - 2]
     switch(svc_number) {
@@ -75,10 +159,10 @@ void SVC_Handler(void)
             ret = k_rtx_init((RTX_SYS_INFO*) args[0], (TASK_INIT *) args[1], (int) args[2]);
             break;
         case SVC_MEM_ALLOC:
-            ret = (U32) k_mpool_alloc(MPID_IRAM1, (size_t) args[0]);
+            ret = (U32) k_mag_alloc(gp_current_task->tid, (size_t) args[0]);
             break;
         case SVC_MEM_DEALLOC:
-            ret = k_mpool_dealloc(MPID_IRAM1, (void *)args[0]);
+            ret = k_mag_dealloc(gp_current_task->tid, (void *)args[0]);
             break;
         case SVC_MEM_DUMP:
             ret = k_mpool_dump(MPID_IRAM1);
@@ -88,7 +172,7 @@ void SVC_Handler(void)
             break;
         case SVC_TSK_EXIT:
             k_tsk_exit();
-            break;
+            return;         // the caller's stack is gone
         case SVC_TSK_YIELD:
             ret = k_tsk_yield();
             break;
@@ -134,6 +218,27 @@ void SVC_Handler(void)
         case SVC_RT_TSK_GET:
             ret = k_rt_tsk_get((task_t) args[0], (TIMEVAL *) args[1]);
             break;
+        case SVC_MEM_STATS:
+            ret = k_mpool_stats((mpool_t) args[0], (MEM_STATS *) args[1]);
+            break;
+        case SVC_MEM_REALLOC:
+            ret = (U32) k_heap_realloc(gp_current_task->tid, (void *) args[0], (size_t) args[1]);
+            break;
+        case SVC_MEM_ALLOC_N:
+            ret = k_heap_alloc_n(gp_current_task->tid, (size_t) args[0], (size_t) args[1], (void **) args[2]);
+            break;
+        case SVC_MEM_DEALLOC_N:
+            ret = k_heap_dealloc_n(gp_current_task->tid, (void **) args[0], (size_t) args[1]);
+            break;
+        case SVC_MEM_IDLE:
+            ret = k_mem_idle();
+            break;
+        case SVC_MEM_CALLOC:
+            ret = (U32) k_heap_calloc(gp_current_task->tid, (size_t) args[0], (size_t) args[1]);
+            break;
+        case SVC_TSK_IDLE:
+            ret = k_tsk_idle();
+            break;
 #ifdef ECE350_P1
         // The following are only for P1 memory testing purpose
         // Future deliverables do not provide the following sys calls to tasks
@@ -151,7 +256,10 @@ void SVC_Handler(void)
             ret = (U32) RTX_ERR;
     }
     
-    args[0] = ret;      // return value saved onto the stacked R0
+    // a call that blocked on a shared kernel stack returns through its continuation
+    if (p_caller == NULL || p_caller->cont == NULL) {
+        args[0] = ret;      // return value saved onto the stacked R0
+    }
 }
 
 
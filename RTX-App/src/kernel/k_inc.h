@@ -68,6 +68,8 @@
 // The following offset macros needs to be modified if you modify
 // the positions of msp field in the TCB structure
 #define TCB_MSP_OFFSET  8       // TCB.msp offset 
+#define TCB_USP_OFFSET  24      // TCB.u_sp offset
+#define TCB_PRIV_OFFSET 34      // TCB.priv offset
 
 typedef struct tcb {
     struct tcb     *prev;        /**< prev tcb, not used in the starter code     					*/
@@ -89,6 +91,9 @@ typedef struct tcb {
     U32            release_time; /**< for RT-tasks. Time when added to rt_queue           */
     U32            timeout;      /**< for RT-tasks. Time until unsuspended                */
     void           (*ptask)();   /**< task entry address                         					*/
+    int            (*cont)(U32 *);/**< SHARED_K_STACK: reruns a blocked call on its stacked args */
+    U32            rt_seq;       /**< for RT-tasks. order among equal keys in g_rt_heap   */
+    U8             rt_slot;      /**< for RT-tasks. index in g_rt_heap while ready        */
 } TCB;
 
 /*
@@ -113,15 +118,25 @@ extern U32 g_p_stacks[NUM_TASKS][PROC_STACK_SIZE >> 2] __attribute__((aligned(8)
 // task related globals are defined in k_task.c
 extern TCB *gp_current_task;    // always point to the current RUNNING task
 
-// TCBs are statically allocated inside the OS image
+// TCBs are statically allocated inside the OS image, or with TCB_ON_DEMAND
+// taken from IRAM2 while the task exists; TCB_OF(tid) works for both
+#if TCB_ON_DEMAND
+extern TCB *g_tcb_table[MAX_TASKS];
+#define TCB_OF(tid)     (*g_tcb_table[tid])
+#else
 extern TCB g_tcbs[MAX_TASKS];
+#define TCB_OF(tid)     (g_tcbs[tid])
+#endif
 extern TASK_INIT g_null_task_info;
 extern U32 g_num_active_tasks;	// number of non-dormant tasks */
 
 extern volatile uint32_t g_timer_count;     // remove if you do not need this variable
 
-extern DLIST prio_queue[4];
-extern DLIST rt_queue;
+extern DLIST prio_queue[PRIO_LEVELS];
+extern U32 g_ready_map;
+extern TCB *g_rt_heap[MAX_TASKS];
+extern U32 g_rt_count;
+extern int g_sched;
 extern DLIST timeout_list;
 
 #endif  // !K_INC_H_
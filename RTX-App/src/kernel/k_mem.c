@@ -39,18 +39,99 @@
  *****************************************************************************/
 #include "k_inc.h"
 #include "k_mem.h"
+#include "k_mem_fixed.h"
+#include "k_mem_tlsf.h"
+#include "k_mem_stack.h"
 #include "btree.h"
 
-DLIST free_list_1 [MEM1_HEIGHT + 1];        
-U8 bit_tree_1[32];
-        
-DLIST free_list_2 [MEM2_HEIGHT + 1];       
-U8 bit_tree_2[256];
+MPOOL g_mpools[NUM_MPOOLS];                 // indexed by mpid, MPID_IRAM1 and MPID_IRAM2 first
+mpool_t g_mbx_mpid = MPID_IRAM2;            // pool mailbox buffers are allocated from
+mpool_t g_stack_mpid = MPID_IRAM2;          // pool task stacks are allocated from
 
-#ifdef DEBUG_2 
-	U32 mem2_space = 0x8000;
-	U32 mem1_space = 0x1000;
-#endif
+#if STATIC_ALLOC
+/*
+ * The boot plan: what k_mem_reserve set aside for each task. Once k_mem_seal
+ * has run, stacks and mailboxes only come from here and IRAM2 requests go to
+ * a fixed pool of kernel buffers, so nothing is split or merged after boot.
+ */
+typedef struct mem_slot {
+    U32     u_stack;                        // high end of the user stack, 0 if none
+    U32     u_size;
+    U32     k_stack;                        // high end of the kernel stack
+    void   *mbx;                            // mailbox buffer, NULL if none
+    U32     mbx_size;
+} MEM_SLOT;
+
+MEM_SLOT g_mem_slots[MAX_TASKS];
+BOOL     g_mem_sealed;
+mpool_t  g_buf_mpid = MPID_IRAM2;           // pool kernel buffers come from once sealed
+
+#define SEALED_MPID(mpid)   ((g_mem_sealed && (mpid) == MPID_IRAM2) ? g_buf_mpid : (mpid))
+#define HEAP_SEALED()       g_mem_sealed    // no IRAM1 is planned, so the user heap is closed
+#else
+#define SEALED_MPID(mpid)   (mpid)
+#define HEAP_SEALED()       FALSE
+#endif /* STATIC_ALLOC */
+
+/*
+ * With MEM_TRACE set every allocation made through the k_mpool and k_mag
+ * entry points is printed as one line, which RTX-App/host/mem_replay reads
+ * back from a captured UART log:
+ *   mt a <mpid> <size> <ptr>           allocation, ptr is 0 if it failed
+ *   mt f <mpid> <ptr>                  deallocation
+ *   mt r <mpid> <ptr> <size> <new>     resize, new is 0 if it failed
+ */
+#if MEM_TRACE
+#define TRACE_ALLOC(mpid, size, ptr)            printf("mt a %d %d 0x%x\r\n", mpid, size, ptr)
+#define TRACE_FREE(mpid, ptr)                   printf("mt f %d 0x%x\r\n", mpid, ptr)
+#define TRACE_REALLOC(mpid, ptr, size, new_ptr) printf("mt r %d 0x%x %d 0x%x\r\n", mpid, ptr, size, new_ptr)
+#else
+#define TRACE_ALLOC(mpid, size, ptr)
+#define TRACE_FREE(mpid, ptr)
+#define TRACE_REALLOC(mpid, ptr, size, new_ptr)
+#endif /* MEM_TRACE */
+
+/*
+ * Control blocks of the two IRAM pools. Pools created at runtime keep their
+ * control block at the front of their own region instead.
+ */
+typedef union mpool_ctrl {
+    BUDDY_POOL  buddy;
+    TLSF_POOL   tlsf;
+    FPOOL       fixed;
+    SPOOL       stack;
+} MPOOL_CTRL;
+
+MPOOL_CTRL iram_ctrl[MAX_MPOOLS];
+
+U8 bit_tree_1[TREE1_INDICIES];
+U8 order_map_1[MEM1_BLOCKS / 2];
+U8 tail_map_1[MEM1_BLOCKS / 8];
+
+U8 bit_tree_2[TREE2_INDICIES];
+U8 order_map_2[MEM2_BLOCKS / 2];
+U8 tail_map_2[MEM2_BLOCKS / 8];
+
+/*
+ * Per-task caches of recently freed IRAM1 blocks, one list per size class
+ * (MIN_BLK_SIZE << class), linked through the first word of each block.
+ */
+typedef struct magazine {
+    void   *head[MAG_CLASSES];
+    U8      count[MAG_CLASSES];
+} MAGAZINE;
+
+MAGAZINE g_magazines[MAX_TASKS];
+U8 cache_map_1[MEM1_BLOCKS / 8];
+U8 clean_map_1[MEM1_BLOCKS / 8];
+
+/*
+ * Owner of each user heap (IRAM1) allocation, indexed by its start address in
+ * OWNER_GRAIN units, the smallest alignment either IRAM1 allocator hands out.
+ * Holds tid + 1 of the task that allocated the block, or 0 if none.
+ */
+#define OWNER_GRAIN     TLSF_ALIGN
+U8 g_heap_owner[RAM1_SIZE / OWNER_GRAIN];
 
 /*---------------------------------------------------------------------------
 The memory map of the OS image may look like the following:
@@ -112,330 +193,1874 @@ The memory map of the OS image may look like the following:
  *===========================================================================
  */
 
-/* note list[n] is for blocks with order of n */
-mpool_t k_mpool_create (int algo, U32 start, U32 end)
+/*
+ * Free list wrappers.
+ * All free list updates go through these so that the pool's free_map
+ * always mirrors which levels currently hold a free block.
+ */
+static void free_list_push(BUDDY_POOL *p_pool, U8 level, DNODE *node)
 {
-#ifdef DEBUG_0
-    printf("k_mpool_init: algo = %d\r\n\r", algo);
-    printf("k_mpool_init: RAM range: [0x%x, 0x%x].\r\n\r", start, end);
-#endif /* DEBUG_0 */    
-    
-    if (algo != BUDDY ) {
-        errno = EINVAL;
-        return RTX_ERR;
-    }
-    
-    if ( start == RAM1_START) {
-        free_list_1[0].head = (void *) RAM1_START;
-				free_list_1[0].head->prev = NULL;
-				free_list_1[0].head->next = NULL;
-        for (U8 level = 1 ; level <= MEM1_HEIGHT ; level++){
-            free_list_1[level].head = NULL;
-        }
+	push_front(&p_pool->free_list[level], node);
+	p_pool->free_map |= BIT(level);
+}
 
-    } else if ( start == RAM2_START) {
-        free_list_2[0].head = (void *) RAM2_START;
-				free_list_2[0].head->prev = NULL;
-				free_list_2[0].head->next = NULL;
-        for (U8 level = 1 ; level <= MEM2_HEIGHT ; level++){
-            free_list_2[level].head = NULL;
-        }
-    } else {
-        errno = EINVAL;
-        return RTX_ERR;
-    }
-    
-    return start == RAM1_START ? MPID_IRAM1 : MPID_IRAM2;
+static DNODE *free_list_pop(BUDDY_POOL *p_pool, U8 level)
+{
+	DNODE *node = pop_front(&p_pool->free_list[level]);
+	if (empty(&p_pool->free_list[level])) {
+		p_pool->free_map &= ~BIT(level);
+	}
+	return node;
 }
 
-void *k_mpool_alloc (mpool_t mpid, size_t size)
+static void free_list_remove(BUDDY_POOL *p_pool, U8 level, DNODE *node)
 {
-	if (size <= 0) {
-		return NULL;
+	remove(&p_pool->free_list[level], node);
+	if (empty(&p_pool->free_list[level])) {
+		p_pool->free_map &= ~BIT(level);
 	}
-	if (size < 32) {
-		size = 32;
+}
+
+/*
+ * Order map accessors.
+ * Each min block has a nibble holding (level + 1) of the allocated block that
+ * starts at it, or 0 if no allocated block starts there.
+ */
+static U8 order_get(U8 *order_map, U32 offset)
+{
+	U32 slot = offset >> MIN_POWER;
+	return (order_map[slot >> 1] >> ((slot & 1) << 2)) & 0xF;
+}
+
+static void order_set(U8 *order_map, U32 offset, U8 order)
+{
+	U32 slot = offset >> MIN_POWER;
+	U8 shift = (slot & 1) << 2;
+	order_map[slot >> 1] = (order_map[slot >> 1] & ~(0xF << shift)) | (order << shift);
+}
+
+/*
+ * Tail and cache map accessors, one bit per min block.
+ * An allocation whose size is not a power of two is made of several buddy
+ * blocks laid out back to back; every block but the first has its tail bit set.
+ * A block held in a task's magazine has its cache bit set.
+ */
+static BOOL flag_get(U8 *map, U32 offset)
+{
+	U32 slot = offset >> MIN_POWER;
+	return (map[slot >> 3] >> (slot & 7)) & 1;
+}
+
+static void flag_set(U8 *map, U32 offset, BOOL flag)
+{
+	U32 slot = offset >> MIN_POWER;
+	if (flag) {
+		map[slot >> 3] |= BIT(slot & 7);
+	} else {
+		map[slot >> 3] &= ~BIT(slot & 7);
 	}
-	if ((mpid != MPID_IRAM1) && (mpid != MPID_IRAM2)) {
-		errno = EINVAL;
-		return NULL;
+}
+
+/*
+ * stores zero to words words from p, four at a time while it can
+ */
+static void zero_words(U32 *p, U32 words)
+{
+	for (; words >= 4; words -= 4, p += 4) {
+		p[0] = 0;
+		p[1] = 0;
+		p[2] = 0;
+		p[3] = 0;
+	}
+	while (words-- > 0) {
+		*p++ = 0;
+	}
+}
+
+/*
+ * marks the min blocks of [offset, offset + size) as no longer zero, called
+ * whenever memory a task has written goes back to the pool
+ */
+static void clean_clear(BUDDY_POOL *p_pool, U32 offset, U32 size)
+{
+	if (p_pool->clean_map == NULL || size == 0) {
+		return;
 	}
 	
-	DNODE *block_ptr = NULL;
-	DNODE *block_mid_ptr = NULL;
+	// one bit per min block: mask the two end bytes, zero whole bytes between
+	U8 *map   = p_pool->clean_map;
+	U32 slot  = offset >> MIN_POWER;
+	U32 last  = (offset + size - 1) >> MIN_POWER;
+	U8  first_mask = (U8)(0xFF << (slot & 7));
+	U8  last_mask  = (U8)(0xFF >> (7 - (last & 7)));
 	
-#ifdef DEBUG_0
-    printf("k_mpool_alloc: mpid = %d, size = %d, 0x%x\r\n\r", mpid, size, size);
-#endif /* DEBUG_0 */
+	if ((slot >> 3) == (last >> 3)) {
+		map[slot >> 3] &= ~(first_mask & last_mask);
+		return;
+	}
+	map[slot >> 3] &= ~first_mask;
+	for (U32 i = (slot >> 3) + 1; i < (last >> 3); i++) {
+		map[i] = 0;
+	}
+	map[last >> 3] &= ~last_mask;
+}
+
+/*
+ * Buddy geometry on the hot paths.
+ * alloc_start, carve, free_block, free_lazy and the bodies of buddy_alloc
+ * and buddy_dealloc take the pool's base and power as arguments and are
+ * always inlined. buddy_alloc and buddy_dealloc pass literals for MPID_IRAM1 and
+ * MPID_IRAM2, whose geometry is fixed at build time, so each IRAM pool
+ * gets its own copy with the shifts folded. Only pools made by
+ * k_mpool_create read base and power from their descriptor.
+ */
+
+/*
+ * returns TRUE if ptr is the first byte of an allocation of the pool that is
+ * not sitting in a magazine
+ */
+static __forceinline BOOL alloc_start(BUDDY_POOL *p_pool, U32 base, U32 power, void *ptr)
+{
+	U32 offset = (U32)ptr - base;
 	
-	if (mpid == MPID_IRAM1) {
-		
-		unsigned int target_level = MEM1_POWER - log2_ceil(size);
+	if ((U32)ptr < base || offset >= (1U << power) || offset < p_pool->reserved) {
+		return FALSE;
+	}
+	return order_get(p_pool->order_map, offset) != 0 && !flag_get(p_pool->tail_map, offset) &&
+	       (p_pool->cache_map == NULL || !flag_get(p_pool->cache_map, offset));
+}
+
+/*
+ * returns the level of the free block starting at offset, or -1 if offset is
+ * not the start of a free block
+ */
+static int free_level(BUDDY_POOL *p_pool, U32 offset)
+{
+	for (int level = 0; level <= p_pool->height; level++) {
+		U32 block_offset = offset & ~(get_block_size(p_pool->power, level) - 1);
 		
-		if ((bottom_up(mpid, target_level) == -1) || (size > RAM1_SIZE)) {
-			errno = ENOMEM;
-			return NULL;
+		if (!is_allocated(p_pool->bit_tree, get_index(level, offset >> (p_pool->power - level)))) {
+			return (block_offset == offset) ? level : -1;
 		}
-		
-		#ifdef DEBUG_2
-			mem1_space = mem1_space - upow(2, MEM1_POWER - target_level); 
-		#endif
-	
-		if (!empty(&free_list_1[target_level])) {
-			block_ptr = free_list_1[target_level].head;
-			pop_front(&free_list_1[target_level]);
-			set_bit(bit_tree_1, get_index(target_level, get_position(mpid, block_ptr, target_level)));
+		if (order_get(p_pool->order_map, block_offset) == level + 1) {
+			return -1;
 		}
-		else {
-			for (int current_level = target_level; current_level >= 0; --current_level) {
-				
-				if (!empty(&free_list_1[current_level])) {
-						
-					block_ptr = free_list_1[current_level].head;
-					for (; current_level < target_level; ++current_level) {
-						set_bit(bit_tree_1, get_index(current_level, get_position(mpid, block_ptr, current_level)));
-							
-						block_mid_ptr = split_addr(mpid, current_level, block_ptr);
-						pop_front(&free_list_1[current_level]);
-							
-						push_front(&free_list_1[current_level + 1], block_mid_ptr);
-						push_front(&free_list_1[current_level + 1], block_ptr);
-					}
+	}
+	return -1;
+}
 
-					set_bit(bit_tree_1, get_index(current_level, get_position(mpid, block_ptr, current_level)));
-					pop_front(&free_list_1[current_level]);
-					break;
-				}
-			}
+/*
+ * Function: carve
+ * ----------------------------
+ *
+ *   block: free block just popped from the free list at level, or a block
+ *          of an allocation being shrunk
+ *   used: bytes to hand out, a multiple of MIN_BLK_SIZE no larger than the block
+ *   tail: TRUE if the block continues an allocation that starts below it
+ *
+ *   Halves the block until the used bytes are covered exactly: a half that
+ *   is not needed goes back on the free list, a half that is fully needed is
+ *   marked allocated and carving continues in the other half. The result is
+ *   at most one allocated block per level, and the unused tail of a request
+ *   that is not a power of two is returned as free buddies.
+ */
+static __forceinline void carve(BUDDY_POOL *p_pool, U32 base, U32 power, int level, DNODE *block, U32 used, BOOL tail)
+{
+	U32 block_size = get_block_size(power, level);
+	
+	while (used < block_size) {
+		set_bit(p_pool->bit_tree, get_index(level, get_position(base, power, block, level)));
+		DNODE *upper = split_addr(power, level, block);
+		block_size >>= 1;
+		level++;
+		
+		if (used <= block_size) {
+			free_list_push(p_pool, level, upper);
+			continue;
 		}
+		
+		// lower half is fully used, keep carving the upper half
+		set_bit(p_pool->bit_tree, get_index(level, get_position(base, power, block, level)));
+		order_set(p_pool->order_map, (U32)block - base, level + 1);
+		flag_set(p_pool->tail_map, (U32)block - base, tail);
+		tail = TRUE;
+		used -= block_size;
+		block = upper;
 	}
 	
-	if (mpid == MPID_IRAM2) {
-		
-    unsigned int target_level = MEM2_POWER - log2_ceil(size);
+	set_bit(p_pool->bit_tree, get_index(level, get_position(base, power, block, level)));
+	order_set(p_pool->order_map, (U32)block - base, level + 1);
+	flag_set(p_pool->tail_map, (U32)block - base, tail);
+}
+
+/*
+ * Function: free_block
+ * ----------------------------
+ *
+ *   Frees one allocated buddy block of the given level and coalesces it with
+ *   its free buddies; returns the size of the block.
+ */
+static __forceinline U32 free_block(BUDDY_POOL *p_pool, U32 base, U32 power, void *ptr, int level)
+{
+	U32 block_size = get_block_size(power, level);
+	
+	// start at the block's own level and only walk up while coalescing
+	unsigned int position = get_position(base, power, ptr, level);
+	for (; level >= 0; --level) {
+		unsigned int index = get_index(level, position);
+		clear_bit(p_pool->bit_tree, index);
 		
-		if ((bottom_up(mpid, target_level) == -1) || (size > RAM2_SIZE)) {
-			errno = ENOMEM;
-			return NULL;
+		unsigned int buddy_index = get_buddy(level, position);
+		if ((index != 0) && !is_allocated(p_pool->bit_tree, buddy_index)) {
+			free_list_remove(p_pool, level, get_address(base, power, level, position ^ 1));
+			position >>= 1;
+			continue;
 		}
 		
-		#ifdef DEBUG_2
-			mem2_space = mem2_space - upow(2, MEM2_POWER - target_level);
-		#endif
+		free_list_push(p_pool, level, get_address(base, power, level, position));
+		break;
+	}
+	return block_size;
+}
+
+/*
+ * Function: free_lazy
+ * ----------------------------
+ *
+ *   Frees one allocated buddy block of the given level without coalescing
+ *   it, so the next request of the same size can take it back without a
+ *   split. The block is remembered until buddy_merge, which runs at the
+ *   latest when LAZY_WATERMARK blocks are waiting; returns its size.
+ */
+static __forceinline U32 free_lazy(BUDDY_POOL *p_pool, U32 base, U32 power, void *ptr, int level)
+{
+	U32 offset = (U32)ptr - base;
+	
+	clear_bit(p_pool->bit_tree, get_index(level, offset >> (power - level)));
+	free_list_push(p_pool, level, ptr);
+	p_pool->lazy[p_pool->lazy_count++] = offset >> MIN_POWER;
+	return get_block_size(power, level);
+}
+
+/*
+ * Function: buddy_merge
+ * ----------------------------
+ *
+ *   Coalesces every block left uncoalesced by free_lazy whose buddy is
+ *   free. Blocks that were allocated again or already absorbed into a
+ *   larger free block in the meantime are skipped.
+ *
+ *   returns: the number of blocks merged.
+ */
+static U32 buddy_merge(BUDDY_POOL *p_pool)
+{
+	U32 merged = 0;
+	
+	while (p_pool->lazy_count > 0) {
+		U32 offset = (U32)p_pool->lazy[--p_pool->lazy_count] << MIN_POWER;
+		int level  = free_level(p_pool, offset);
 		
-		if (!empty(&free_list_2[target_level])) {
-			block_ptr = free_list_2[target_level].head;
-			pop_front(&free_list_2[target_level]);
-			set_bit(bit_tree_2, get_index(target_level, get_position(mpid, block_ptr, target_level)));
+		if (level > 0 &&
+		    !is_allocated(p_pool->bit_tree, get_buddy(level, offset >> (p_pool->power - level)))) {
+			DNODE *block = (DNODE *)(p_pool->base + offset);
+			free_list_remove(p_pool, level, block);
+			free_block(p_pool, p_pool->base, p_pool->power, block, level);
+			merged++;
 		}
-		else {
-			for (int current_level = target_level; current_level >= 0; --current_level) {
-				
-				if (!empty(&free_list_2[current_level])) {
-						
-					block_ptr = free_list_2[current_level].head;
-					for (; current_level < target_level; ++current_level) {
-						set_bit(bit_tree_2, get_index(current_level, get_position(mpid, block_ptr, current_level)));
-							
-						block_mid_ptr = split_addr(mpid, current_level, block_ptr);
-						pop_front(&free_list_2[current_level]);
-							
-						push_front(&free_list_2[current_level + 1], block_mid_ptr);
-						push_front(&free_list_2[current_level + 1], block_ptr);
-					}
+	}
+	return merged;
+}
 
-					set_bit(bit_tree_2, get_index(current_level, get_position(mpid, block_ptr, current_level)));
-					pop_front(&free_list_2[current_level]);
-					break;
+/*
+ * Function: buddy_prezero
+ * ----------------------------
+ *
+ *   Zeroes up to budget dirty min blocks of free memory, largest free blocks
+ *   first, and marks them clean. The list node at the start of a free block
+ *   is left alone, so a clean min block is zero except for its first
+ *   sizeof(DNODE) bytes, which the allocator keeps writing as blocks are
+ *   split and merged.
+ *
+ *   returns: the number of min blocks zeroed.
+ */
+static U32 buddy_prezero(BUDDY_POOL *p_pool, U32 budget)
+{
+	U32 zeroed = 0;
+	
+	for (int level = 0; level <= p_pool->height && zeroed < budget; level++) {
+		U32 block_size = get_block_size(p_pool->power, level);
+		
+		for (DNODE *node = p_pool->free_list[level].head; node != NULL && zeroed < budget; node = node->next) {
+			U32 offset = (U32)node - p_pool->base;
+			
+			for (U32 next = offset; next < offset + block_size && zeroed < budget; next += MIN_BLK_SIZE) {
+				if (!flag_get(p_pool->clean_map, next)) {
+					U32 skip = (next == offset) ? sizeof(DNODE) : 0;
+					zero_words((U32 *)(p_pool->base + next + skip), (MIN_BLK_SIZE - skip) >> 2);
+					flag_set(p_pool->clean_map, next, TRUE);
+					zeroed++;
 				}
 			}
 		}
 	}
-
-  return block_ptr;
+	return zeroed;
 }
 
 /*
- * Function: k_mpool_dealloc
+ * Function: buddy_create
  * ----------------------------
  *
- *   mpid: Memory Pool ID
- *   ptr: Address of block to be deallocated
+ *   Sets up a buddy pool of 2^power bytes at base whose maps live at the
+ *   given addresses, with the whole pool as one free block.
+ */
+static void buddy_create(BUDDY_POOL *p_pool, U32 base, U8 power, U8 *bit_tree, U8 *order_map, U8 *tail_map)
+{
+	U32 blocks = 1U << (power - MIN_POWER);
+	
+	p_pool->base      = base;
+	p_pool->power     = power;
+	p_pool->height    = power - MIN_POWER;
+	p_pool->reserved  = 0;
+	p_pool->free_map  = 0;
+	p_pool->bit_tree  = bit_tree;
+	p_pool->order_map = order_map;
+	p_pool->tail_map  = tail_map;
+	p_pool->cache_map = NULL;
+	p_pool->clean_map = NULL;
+	p_pool->lazy_count = 0;
+	
+	for (U8 level = 0; level <= MAX_BUDDY_HEIGHT; level++) {
+		p_pool->free_list[level].head = NULL;
+		p_pool->free_list[level].tail = NULL;
+	}
+	for (U32 i = 0; i < blocks / 4; i++) {
+		bit_tree[i] = 0;
+	}
+	for (U32 i = 0; i < blocks / 2; i++) {
+		order_map[i] = 0;
+	}
+	for (U32 i = 0; i < blocks / 8; i++) {
+		tail_map[i] = 0;
+	}
+}
+
+/*
+ * Function: buddy_create_in_place
+ * ----------------------------
  *
- *   returns: 0 if memory is deallocated, or -1 if error.
+ *   Sets up a buddy pool over the largest power of two that fits in
+ *   [start, end], keeping the control block and maps in its first blocks,
+ *   which stay allocated for the life of the pool.
  *
- *	 1. Start at relative position of pointer at bottom of tree.
- *	 2. If index is allocated, clear bit in tree and check if buddy is also free.
- *			a) If buddy free, remove buddy from free list and then repeat step 2 at above level for parent node (coalesce).
- *			b) If buddy is not free, just push the current node to the free list.
- *	
+ *   returns: the control block, or NULL if the range is too small.
  */
-int k_mpool_dealloc(mpool_t mpid, void *ptr)
+static BUDDY_POOL *buddy_create_in_place(U32 start, U32 end)
 {
-	//Input validation
-	if (ptr == NULL) {
-		return RTX_OK;
+	U32 base = (start + 7) & ~7U;
+	if (base > end || end + 1 - base < (MIN_BLK_SIZE << 3)) {
+		return NULL;
 	}
-	if (mpid != MPID_IRAM1 && mpid != MPID_IRAM2) {
-		errno = EINVAL;
-		return RTX_ERR;
+	
+	U8 power = 31 - clz(end + 1 - base);
+	power = (power > MAX_BUDDY_HEIGHT + MIN_POWER) ? MAX_BUDDY_HEIGHT + MIN_POWER : power;
+	
+	U32 blocks = 1U << (power - MIN_POWER);
+	U32 meta   = (sizeof(BUDDY_POOL) + 3) & ~3U;
+	U8 *maps   = (U8 *)(base + meta);
+	meta += blocks / 4 + blocks / 2 + blocks / 8;
+	meta  = (meta + MIN_BLK_SIZE - 1) & ~(MIN_BLK_SIZE - 1);
+	if (meta >= (1U << power)) {
+		return NULL;
 	}
 	
-	//Check if pointer falls in appropriate memory pool
-	if (mpid == MPID_IRAM1 && !((unsigned int)ptr >= RAM1_START && (unsigned int)ptr < RAM1_END)) {
-		errno = EFAULT;
-		return RTX_ERR;
+	BUDDY_POOL *p_pool = (BUDDY_POOL *)base;
+	buddy_create(p_pool, base, power, maps, maps + blocks / 4, maps + blocks / 4 + blocks / 2);
+	
+	// allocate the metadata from the root instead of pushing it, which would overwrite p_pool
+	carve(p_pool, base, power, 0, (DNODE *)base, meta, FALSE);
+	p_pool->reserved = meta;
+	return p_pool;
+}
+
+static __forceinline void *buddy_alloc_in(mpool_t mpid, BUDDY_POOL *p_pool, U32 base, U32 power, size_t size)
+{
+	if (size > (1U << power)) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	
+	U32 used = (size + MIN_BLK_SIZE - 1) & ~(MIN_BLK_SIZE - 1);
+	int current_level = bottom_up(p_pool, get_level(power, used));
+	
+	// the free space may only be missing a merge
+	if (current_level < 0 && buddy_merge(p_pool) > 0) {
+		current_level = bottom_up(p_pool, get_level(power, used));
+	}
+	
+	if (current_level < 0) {
+		errno = ENOMEM;
+		return NULL;
 	}
-	if (mpid == MPID_IRAM2 && !((unsigned int)ptr >= RAM2_START && (unsigned int)ptr < RAM2_END)) {
+	
+	// split the smallest fitting free block down to the bytes actually used, keeping the lower part
+	DNODE *block_ptr = free_list_pop(p_pool, current_level);
+	carve(p_pool, base, power, current_level, block_ptr, used, FALSE);
+	
+	k_mpool_used(mpid, used);
+	return block_ptr;
+}
+
+static void *buddy_alloc(mpool_t mpid, BUDDY_POOL *p_pool, size_t size)
+{
+	if (mpid == MPID_IRAM1) {
+		return buddy_alloc_in(MPID_IRAM1, p_pool, RAM1_START, MEM1_POWER, size);
+	}
+	if (mpid == MPID_IRAM2) {
+		return buddy_alloc_in(MPID_IRAM2, p_pool, RAM2_START, MEM2_POWER, size);
+	}
+	return buddy_alloc_in(mpid, p_pool, p_pool->base, p_pool->power, size);
+}
+
+/*
+ *	 1. Look up the block's level in the order map; fail if no allocated block starts at ptr.
+ *	 2. Clear the node's bit in the tree and check if its buddy is also free.
+ *			a) If buddy free, remove buddy from free list and then repeat step 2 at above level for parent node (coalesce).
+ *			b) If buddy is not free, just push the current node to the free list.
+ *	 3. Repeat for every tail block carved right after it (see carve).
+ */
+static __forceinline int buddy_dealloc_in(mpool_t mpid, BUDDY_POOL *p_pool, U32 base, U32 power, void *ptr)
+{
+	U32 offset = (U32)ptr - base;
+	U32 limit  = 1U << power;
+	
+	// outside the pool, in its metadata, or not the start of a live allocation (e.g. a double free)
+	if (!alloc_start(p_pool, base, power, ptr)) {
 		errno = EFAULT;
 		return RTX_ERR;
 	}
 	
-#ifdef DEBUG_0
-    printf("k_mpool_dealloc: mpid = %d, ptr = 0x%x\r\n\r", mpid, ptr);
-#endif /* DEBUG_0 */
+	U8 order = order_get(p_pool->order_map, offset);
 	
-	if (mpid == MPID_IRAM1) {
-		
-		#ifdef DEBUG_2
-			U8 flag = 0;
-		#endif
-		
-		unsigned int position = get_position(mpid, ptr, MEM1_HEIGHT);
-		for (int level = MEM1_HEIGHT; level >= 0; --level) {
-			unsigned int index = get_index(level, position);
-			
-			if (is_allocated(bit_tree_1, index)) {
-				clear_bit(bit_tree_1, index);
-				
-				#ifdef DEBUG_2
-					if (!flag) {
-						mem1_space = mem1_space + upow(2, MEM1_POWER - level);
-						flag = 1;
-					}
-				#endif
-				
-				unsigned int buddy_index = get_buddy(level, position);
-				if (!is_allocated(bit_tree_1, buddy_index) && (index != 0)) {
-					remove(&free_list_1[level], get_address(mpid, level, position + (buddy_index - index)));
-					position /= 2;
-					continue;
-				}
-				
-				DNODE *block_addr = get_address(mpid, level, position);
-				block_addr->next = NULL;
-				block_addr->prev = NULL;
-				push_front(&free_list_1[level], block_addr);
-				break;
-			}
-			
-			position /= 2;
+	// free the first block, then every tail block carved after it
+	do {
+		// at the watermark, settle the deferred blocks first so the cost stays bounded
+		if (LAZY_WATERMARK > 0 && p_pool->lazy_count == LAZY_WATERMARK) {
+			buddy_merge(p_pool);
 		}
 		
+		order_set(p_pool->order_map, offset, 0);
+		flag_set(p_pool->tail_map, offset, FALSE);
+		clean_clear(p_pool, offset, get_block_size(power, order - 1));
+		U32 freed = (LAZY_WATERMARK > 0) ?
+		            free_lazy(p_pool, base, power, (void *)(base + offset), order - 1) :
+		            free_block(p_pool, base, power, (void *)(base + offset), order - 1);
+		k_mpool_used(mpid, -(int)freed);
+		
+		offset += freed;
+		order = (offset < limit) ? order_get(p_pool->order_map, offset) : 0;
+	} while (order != 0 && flag_get(p_pool->tail_map, offset));
+	
+	return RTX_OK;
+}
+
+static int buddy_dealloc(mpool_t mpid, BUDDY_POOL *p_pool, void *ptr)
+{
+	if (mpid == MPID_IRAM1) {
+		return buddy_dealloc_in(MPID_IRAM1, p_pool, RAM1_START, MEM1_POWER, ptr);
 	}
 	if (mpid == MPID_IRAM2) {
+		return buddy_dealloc_in(MPID_IRAM2, p_pool, RAM2_START, MEM2_POWER, ptr);
+	}
+	return buddy_dealloc_in(mpid, p_pool, p_pool->base, p_pool->power, ptr);
+}
+
+/*
+ * Function: carve_n
+ * ----------------------------
+ *
+ *   Splits a free block of the given level into count blocks of the target
+ *   level, each its own allocation, and stores them in out lowest address
+ *   first. The nodes above the children are split once for the whole batch
+ *   and the unused upper part goes back on the free lists as in carve.
+ */
+static void carve_n(BUDDY_POOL *p_pool, int level, DNODE *block, int target, U32 count, void **out)
+{
+	U32 base   = p_pool->base;
+	U32 power  = p_pool->power;
+	U32 size   = get_block_size(power, target);
+	U32 offset = (U32)block - base;
+	U32 end    = offset + count * size;
+	U32 i      = 0;
+	
+	carve(p_pool, base, power, level, block, count * size, FALSE);
+	
+	// carve left pieces of decreasing size, break each one up into target sized children
+	while (offset < end) {
+		int piece = order_get(p_pool->order_map, offset) - 1;
+		U32 piece_end = offset + get_block_size(power, piece);
 		
-		#ifdef DEBUG_2
-			U8 flag = 0;
-		#endif
-		
-		unsigned int position = get_position(mpid, ptr, MEM2_HEIGHT);
-		for (int level = MEM2_HEIGHT; level >= 0; --level) {
-			unsigned int index = get_index(level, position);
+		for (int l = piece + 1; l <= target; l++) {
+			for (U32 pos = offset >> (power - l); pos < (piece_end >> (power - l)); pos++) {
+				set_bit(p_pool->bit_tree, get_index(l, pos));
+			}
+		}
+		for (; offset < piece_end; offset += size) {
+			order_set(p_pool->order_map, offset, target + 1);
+			flag_set(p_pool->tail_map, offset, FALSE);
+			out[i++] = (void *)(base + offset);
+		}
+	}
+}
+
+/*
+ * Function: buddy_alloc_n
+ * ----------------------------
+ *
+ *   Allocates count blocks of size bytes, all or none.
+ *   Power of two sizes are cut from as few free blocks as possible: the
+ *   smallest free block holding the whole batch if there is one, otherwise
+ *   the largest free blocks one after another. Other sizes are carved to
+ *   fit one by one, as every block has its own tail.
+ */
+static int buddy_alloc_n(mpool_t mpid, BUDDY_POOL *p_pool, size_t size, U32 count, void **out)
+{
+	U32 done = 0;
+	
+	if (size > (1U << p_pool->power)) {
+		errno = ENOMEM;
+		return RTX_ERR;
+	}
+	
+	U32 used = (size + MIN_BLK_SIZE - 1) & ~(MIN_BLK_SIZE - 1);
+	int target = get_level(p_pool->power, used);
+	
+	if ((used & (used - 1)) != 0) {
+		for (; done < count && (out[done] = buddy_alloc(mpid, p_pool, size)) != NULL; done++);
+	} else {
+		while (done < count) {
+			U32 want = count - done;
+			int fit = target - ((want > 1) ? (int)(32 - clz(want - 1)) : 0);
+			int level = (fit >= 0) ? bottom_up(p_pool, fit) : -1;
 			
-			if (is_allocated(bit_tree_2, index)) {
-				clear_bit(bit_tree_2, index);
-				
-				#ifdef DEBUG_2
-					if (!flag) {
-						mem2_space = mem2_space + upow(2, MEM2_POWER - level);
-						flag = 1;
+			if (level < 0) {
+				U32 free_map = p_pool->free_map & (U32)((BIT(target) << 1) - 1);
+				if (free_map == 0) {
+					if (buddy_merge(p_pool) > 0) {
+						continue;
 					}
-				#endif
-				
-				unsigned int buddy_index = get_buddy(level, position);
-				if (!is_allocated(bit_tree_2, get_buddy(level, position)) && (index != 0)) {
-					remove(&free_list_2[level], get_address(mpid, level, position + (buddy_index - index)));
-					position /= 2;
-					continue;
+					break;
 				}
-				
-				DNODE *block_addr = get_address(mpid, level, position);
-				block_addr->next = NULL;
-				block_addr->prev = NULL;
-				push_front(&free_list_2[level], block_addr);
-				break;
+				level = 31 - clz(free_map & (~free_map + 1));   // largest free block
+				want = 1U << (target - level);
 			}
 			
-			position /= 2;
+			carve_n(p_pool, level, free_list_pop(p_pool, level), target, want, out + done);
+			k_mpool_used(mpid, want * used);
+			done += want;
 		}
 	}
-    
-    return RTX_OK; 
-}
+	
+	if (done < count) {
+		while (done > 0) {
+			buddy_dealloc(mpid, p_pool, out[--done]);
+		}
+		errno = ENOMEM;
+		return RTX_ERR;
+	}
+	return RTX_OK;
+}
+
+/*
+ * Function: buddy_resize
+ * ----------------------------
+ *
+ *   Resizes an allocation without moving it.
+ *   Growing absorbs the free buddies that follow the allocation as extra
+ *   tail blocks, the last one carved down to the bytes still needed; it
+ *   fails with ENOMEM if any byte up to the new end is not free.
+ *   Shrinking carves the block holding the new end, which releases its
+ *   upper halves, and frees every tail block past it.
+ *
+ *   p_old: set to the current size of the allocation
+ */
+/*
+ * returns the bytes of the allocation starting at offset, its first block and all its tails
+ */
+static U32 buddy_size(BUDDY_POOL *p_pool, U32 offset)
+{
+	U32 limit = 1U << p_pool->power;
+	U32 end   = offset;
+	U8 order  = order_get(p_pool->order_map, offset);
+	
+	do {
+		end += get_block_size(p_pool->power, order - 1);
+		order = (end < limit) ? order_get(p_pool->order_map, end) : 0;
+	} while (order != 0 && flag_get(p_pool->tail_map, end));
+	
+	return end - offset;
+}
+
+/*
+ * takes the block at offset out of the magazine caching it and frees it, so a
+ * growing neighbour can absorb it. Returns FALSE if no magazine holds it.
+ */
+static BOOL mag_reclaim(mpool_t mpid, BUDDY_POOL *p_pool, U32 offset)
+{
+	void *block = (void *)(p_pool->base + offset);
+	
+	if (p_pool->cache_map == NULL || !flag_get(p_pool->cache_map, offset)) {
+		return FALSE;
+	}
+	// cached blocks are whole blocks of a class size, see mag_class
+	int cls = p_pool->power - (order_get(p_pool->order_map, offset) - 1) - MIN_POWER;
+	
+	for (int tid = 0; tid < MAX_TASKS; tid++) {
+		MAGAZINE *p_mag = &g_magazines[tid];
+		
+		for (void **p_link = &p_mag->head[cls]; *p_link != NULL; p_link = (void **)*p_link) {
+			if (*p_link == block) {
+				*p_link = *(void **)block;
+				p_mag->count[cls]--;
+				flag_set(p_pool->cache_map, offset, FALSE);
+				buddy_dealloc(mpid, p_pool, block);
+				return TRUE;
+			}
+		}
+	}
+	return FALSE;
+}
+
+static int buddy_resize(mpool_t mpid, BUDDY_POOL *p_pool, void *ptr, size_t size, U32 *p_old)
+{
+	U32 base   = p_pool->base;
+	U32 power  = p_pool->power;
+	U32 offset = (U32)ptr - base;
+	U32 limit  = 1U << power;
+	
+	if (!alloc_start(p_pool, base, power, ptr)) {
+		errno = EFAULT;
+		return RTX_ERR;
+	}
+	
+	U32 end = offset + buddy_size(p_pool, offset);
+	*p_old = end - offset;
+	
+	if (size > limit - offset) {
+		errno = ENOMEM;
+		return RTX_ERR;
+	}
+	U32 new_end = offset + ((size + MIN_BLK_SIZE - 1) & ~(MIN_BLK_SIZE - 1));
+	
+	if (new_end > end) {
+		for (U32 next = end; next < new_end; ) {
+			int level = free_level(p_pool, next);
+			if (level < 0 && mag_reclaim(mpid, p_pool, next)) {
+				level = free_level(p_pool, next);   // a cached block is free to the pool
+			}
+			if (level < 0) {
+				errno = ENOMEM;
+				return RTX_ERR;
+			}
+			next += get_block_size(power, level);
+		}
+		
+		for (U32 next = end; next < new_end; ) {
+			int level = free_level(p_pool, next);
+			U32 block_size = get_block_size(power, level);
+			U32 used = (new_end - next < block_size) ? new_end - next : block_size;
+			
+			free_list_remove(p_pool, level, (DNODE *)(base + next));
+			carve(p_pool, base, power, level, (DNODE *)(base + next), used, TRUE);
+			next += used;
+		}
+	} else {
+		for (U32 next = offset; next < end; ) {
+			U8 order = order_get(p_pool->order_map, next);
+			U32 block_size = get_block_size(power, order - 1);
+			
+			if (next >= new_end) {
+				order_set(p_pool->order_map, next, 0);
+				flag_set(p_pool->tail_map, next, FALSE);
+				clean_clear(p_pool, next, block_size);
+				free_block(p_pool, base, power, (void *)(base + next), order - 1);
+			} else if (next + block_size > new_end) {
+				clean_clear(p_pool, new_end, next + block_size - new_end);
+				carve(p_pool, base, power, order - 1, (DNODE *)(base + next), new_end - next, next != offset);
+			}
+			next += block_size;
+		}
+	}
+	
+	k_mpool_used(mpid, (int)(new_end - end));
+	return RTX_OK;
+}
+
+static int buddy_dump(BUDDY_POOL *p_pool)
+{
+	int block_count = 0;
+	
+	buddy_merge(p_pool);    // list blocks as they would be with eager coalescing
+	
+	for (int i = p_pool->height; i >= 0; i--) {
+		for (DNODE *traverse = p_pool->free_list[i].head; traverse != NULL; traverse = traverse->next) {
+			block_count++;
+			printf("0x%x: 0x%x\n\r", traverse, get_block_size(p_pool->power, i));
+		}
+	}
+	printf("%d free memory block(s) found\n\r", block_count);
+	return block_count;
+}
+
+static void buddy_stats(BUDDY_POOL *p_pool, MEM_STATS *out)
+{
+	for (int level = 0; level <= p_pool->height; level++) {
+		U32 count = 0;
+		for (DNODE *node = p_pool->free_list[level].head; node != NULL; node = node->next) {
+			count++;
+		}
+		k_mpool_free_blocks(out, get_block_size(p_pool->power, level), count);
+	}
+}
+
+/*
+ * returns TRUE if [start, end] lies inside one allocation of the pool
+ */
+static BOOL buddy_is_reserved(BUDDY_POOL *p_pool, U32 start, U32 end)
+{
+	U32 base   = p_pool->base;
+	U32 power  = p_pool->power;
+	U32 offset = start - base;
+	
+	if (start < base || offset >= (1U << power) || offset < p_pool->reserved) {
+		return FALSE;
+	}
+	for (int level = p_pool->height; level >= 0; --level) {
+		U32 block_size = get_block_size(power, level);
+		U32 block_offset = offset & ~(block_size - 1);
+		if (order_get(p_pool->order_map, block_offset) == level + 1) {
+			if (p_pool->cache_map != NULL && flag_get(p_pool->cache_map, block_offset)) {
+				return FALSE;
+			}
+			// the range may run on into the tail blocks of the same allocation
+			U32 limit = block_offset + block_size;
+			while ((end - base) >= limit && limit < (1U << power) &&
+			       order_get(p_pool->order_map, limit) != 0 && flag_get(p_pool->tail_map, limit)) {
+				limit += get_block_size(power, order_get(p_pool->order_map, limit) - 1);
+			}
+			return (end - base) < limit;
+		}
+	}
+	return FALSE;
+}
+
+/*
+ * Function: bottom_up
+ * ----------------------------
+ *
+ *   p_pool: buddy pool
+ *   level: target level of the request
+ *
+ *   returns: the deepest level in [0, level] holding a free block, or -1 if none.
+ *
+ *   Levels below the target are masked off the pool's free_map and the highest
+ *   remaining bit is found with a single CLZ, so the search cost is the same
+ *   however fragmented the pool is.
+ */
+int bottom_up(BUDDY_POOL *p_pool, U8 level)
+{	
+		U32 free_map = p_pool->free_map & (U32)((BIT(level) << 1) - 1);
+		
+		if (free_map == 0) {
+				return -1;
+		}
+
+    return 31 - clz(free_map);  
+}
+
+/*
+ * returns the descriptor of a pool in use, NULL if mpid names none
+ */
+static MPOOL *get_mpool(mpool_t mpid)
+{
+	if (mpid < 0 || mpid >= NUM_MPOOLS || g_mpools[mpid].ctrl == NULL) {
+		return NULL;
+	}
+	return &g_mpools[mpid];
+}
+
+/*
+ * returns the pool with the smallest region containing [start, end], NULL if none
+ */
+static MPOOL *innermost_mpool(U32 start, U32 end)
+{
+	MPOOL *p_found = NULL;
+	
+	for (int i = 0; i < NUM_MPOOLS; i++) {
+		MPOOL *p_mpool = &g_mpools[i];
+		if (p_mpool->ctrl != NULL && start >= p_mpool->start && end <= p_mpool->end &&
+		    (p_found == NULL || p_mpool->end - p_mpool->start < p_found->end - p_found->start)) {
+			p_found = p_mpool;
+		}
+	}
+	return p_found;
+}
+
+/*
+ * Function: mpool_create
+ * ----------------------------
+ *
+ *   The full IRAM1/IRAM2 ranges go to MPID_IRAM1/MPID_IRAM2 with static
+ *   control blocks. Any other range must lie inside one allocation of an
+ *   existing pool (see k_mem_is_reserved) and must not overlap another pool
+ *   made over such a range; it gets the first free descriptor and keeps its
+ *   control block at the front of the range.
+ */
+static mpool_t mpool_create(int algo, U32 start, U32 end, size_t obj_size)
+{
+	mpool_t mpid = -1;
+	void *ctrl   = NULL;
+	
+	if (algo != BUDDY && algo != TLSF && algo != FIXED_POOL && algo != STACK_POOL) {
+		errno = EINVAL;
+		return RTX_ERR;
+	}
+	
+	if (start == RAM1_START && end == RAM1_END) {
+		mpid = MPID_IRAM1;
+	} else if (start == RAM2_START && end == RAM2_END) {
+		mpid = MPID_IRAM2;
+	} else {
+		if (end <= start || !k_mem_is_reserved(start, end)) {
+			errno = EINVAL;
+			return RTX_ERR;
+		}
+		for (int i = MAX_MPOOLS; i < NUM_MPOOLS; i++) {
+			MPOOL *p_mpool = &g_mpools[i];
+			if (p_mpool->ctrl == NULL) {
+				mpid = (mpid < 0) ? i : mpid;
+			} else if (start <= p_mpool->end && end >= p_mpool->start &&
+			           !(start >= p_mpool->start && end <= p_mpool->end)) {
+				errno = EINVAL;
+				return RTX_ERR;
+			}
+		}
+		if (mpid < 0) {
+			errno = EAGAIN;
+			return RTX_ERR;
+		}
+	}
+	
+	MPOOL *p_mpool = &g_mpools[mpid];
+	U32 region = start;
+	
+	if (mpid < MAX_MPOOLS) {
+		ctrl = &iram_ctrl[mpid];
+	} else if (algo == STACK_POOL) {
+		ctrl   = (void *)((start + 7) & ~7U);
+		region = (U32)ctrl + sizeof(SPOOL);
+	} else if (algo != BUDDY) {
+		// TLSF and fixed pools manage what is left after their control block
+		ctrl   = (void *)((start + 7) & ~7U);
+		region = (U32)ctrl + ((algo == TLSF) ? sizeof(TLSF_POOL) : sizeof(FPOOL));
+	}
+	
+	if (algo == BUDDY) {
+		if (mpid == MPID_IRAM1) {
+			buddy_create(ctrl, RAM1_START, MEM1_POWER, bit_tree_1, order_map_1, tail_map_1);
+			free_list_push(ctrl, 0, (DNODE *)RAM1_START);
+			for (U32 i = 0; i < MEM1_BLOCKS / 8; i++) {
+				cache_map_1[i] = 0;
+				clean_map_1[i] = 0;
+			}
+			((BUDDY_POOL *)ctrl)->cache_map = cache_map_1;
+			((BUDDY_POOL *)ctrl)->clean_map = clean_map_1;
+		} else if (mpid == MPID_IRAM2) {
+			buddy_create(ctrl, RAM2_START, MEM2_POWER, bit_tree_2, order_map_2, tail_map_2);
+			free_list_push(ctrl, 0, (DNODE *)RAM2_START);
+		} else {
+			ctrl = buddy_create_in_place(start, end);
+		}
+	} else if (region > end ||
+	           (algo == TLSF && k_tlsf_create(ctrl, region, end) != RTX_OK) ||
+	           (algo == FIXED_POOL && k_fpool_create(ctrl, region, end, obj_size) != RTX_OK) ||
+	           (algo == STACK_POOL && k_spool_create(ctrl, region, end) != RTX_OK)) {
+		ctrl = NULL;
+	}
+	
+	if (ctrl == NULL) {
+		errno = EINVAL;
+		return RTX_ERR;
+	}
+	
+	MEM_STATS empty_stats = {0};
+	p_mpool->algo  = algo;
+	p_mpool->start = start;
+	p_mpool->end   = end;
+	p_mpool->stats = empty_stats;
+	p_mpool->ctrl  = ctrl;
+	return mpid;
+}
+
+/*
+ * Function: k_mpool_create
+ * ----------------------------
+ *
+ *   algo: BUDDY, TLSF, FIXED_POOL with MIN_BLK_SIZE objects, or STACK_POOL
+ *   start: first byte of the region
+ *   end: last byte of the region
+ *
+ *   returns: the new pool's mpid, or -1 if error.
+ */
+mpool_t k_mpool_create (int algo, U32 start, U32 end)
+{
+#ifdef DEBUG_0
+    printf("k_mpool_init: algo = %d\r\n\r", algo);
+    printf("k_mpool_init: RAM range: [0x%x, 0x%x].\r\n\r", start, end);
+#endif /* DEBUG_0 */    
+    
+    return mpool_create(algo, start, end, MIN_BLK_SIZE);
+}
+
+/*
+ * creates a FIXED_POOL of obj_size objects, see k_mpool_create
+ */
+mpool_t k_mpool_create_fixed(U32 start, U32 end, size_t obj_size)
+{
+    return mpool_create(FIXED_POOL, start, end, obj_size);
+}
+
+/*
+ * allocation and free for the pools that are not buddy pools
+ */
+static void *pool_alloc(mpool_t mpid, int algo, size_t size)
+{
+    if (algo == TLSF) {
+        return k_tlsf_alloc(mpid, size);
+    }
+    if (algo == STACK_POOL) {
+        return k_spool_alloc(mpid, size);
+    }
+    return k_fpool_alloc(mpid, size);
+}
+
+static int pool_dealloc(mpool_t mpid, int algo, void *ptr)
+{
+    if (algo == TLSF) {
+        return k_tlsf_dealloc(mpid, ptr);
+    }
+    if (algo == STACK_POOL) {
+        return k_spool_dealloc(mpid, ptr);
+    }
+    return k_fpool_dealloc(mpid, ptr);
+}
+
+/*
+ * k_mpool_alloc and k_mpool_dealloc without the trace, for k_mpool_realloc and
+ * for the sub-pool regions k_mem_init carves out, which a replay recreates itself
+ */
+static void *mpool_alloc(mpool_t mpid, size_t size)
+{
+    MPOOL *p_mpool = get_mpool(mpid);
+    void *ptr = NULL;
+    
+    if (p_mpool == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (size <= 0) {
+        return NULL;
+    }
+    
+    if (p_mpool->algo == BUDDY) {
+        ptr = buddy_alloc(mpid, p_mpool->ctrl, size);
+    } else {
+        ptr = pool_alloc(mpid, p_mpool->algo, size);
+    }
+    
+    if (ptr == NULL) {
+        p_mpool->stats.num_failed++;
+    } else {
+        p_mpool->stats.num_alloc++;
+    }
+    return ptr;
+}
+
+static int mpool_dealloc(mpool_t mpid, void *ptr)
+{
+    MPOOL *p_mpool = get_mpool(mpid);
+    int ret_val = RTX_ERR;
+    
+    if (ptr == NULL) {
+        return RTX_OK;
+    }
+    if (p_mpool == NULL) {
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+    
+    if (p_mpool->algo == BUDDY) {
+        ret_val = buddy_dealloc(mpid, p_mpool->ctrl, ptr);
+    } else {
+        ret_val = pool_dealloc(mpid, p_mpool->algo, ptr);
+    }
+    
+    if (ret_val == RTX_OK) {
+        p_mpool->stats.num_free++;
+    }
+    return ret_val;
+}
+
+void *k_mpool_alloc (mpool_t mpid, size_t size)
+{
+#ifdef DEBUG_0
+    printf("k_mpool_alloc: mpid = %d, size = %d, 0x%x\r\n\r", mpid, size, size);
+#endif /* DEBUG_0 */
+    
+    mpid = SEALED_MPID(mpid);
+    void *ptr = mpool_alloc(mpid, size);
+    
+    TRACE_ALLOC(mpid, size, ptr);
+    return ptr;
+}
+
+/*
+ * Function: k_mpool_dealloc
+ * ----------------------------
+ *
+ *   mpid: Memory Pool ID
+ *   ptr: Address of block to be deallocated
+ *
+ *   returns: 0 if memory is deallocated, or -1 if error.
+ */
+int k_mpool_dealloc (mpool_t mpid, void *ptr)
+{
+#ifdef DEBUG_0
+    printf("k_mpool_dealloc: mpid = %d, ptr = 0x%x\r\n\r", mpid, ptr);
+#endif /* DEBUG_0 */
+    
+    mpid = SEALED_MPID(mpid);
+    int ret_val = mpool_dealloc(mpid, ptr);
+    
+    if (ret_val == RTX_OK && ptr != NULL) {
+        TRACE_FREE(mpid, ptr);
+    }
+    return ret_val;
+}
+
+/*
+ * Function: k_mpool_realloc
+ * ----------------------------
+ *
+ *   mpid: Memory Pool ID
+ *   ptr: Address of an allocated block, or NULL to allocate
+ *   size: new size in bytes, 0 to deallocate
+ *
+ *   returns: the resized block, ptr itself whenever the pool could resize it
+ *            in place, or NULL if error, in which case ptr is left untouched.
+ *
+ *   The block is only moved, by allocating, copying and deallocating, when
+ *   it cannot grow in place.
+ */
+static void *mpool_realloc(mpool_t mpid, void *ptr, size_t size)
+{
+    MPOOL *p_mpool = get_mpool(mpid);
+    U32 old_size = 0;
+    int ret_val = RTX_ERR;
+    
+    if (ptr == NULL) {
+        return mpool_alloc(mpid, size);
+    }
+    if (p_mpool == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (size == 0) {
+        mpool_dealloc(mpid, ptr);
+        return NULL;
+    }
+    
+    if (p_mpool->algo == BUDDY) {
+        ret_val = buddy_resize(mpid, p_mpool->ctrl, ptr, size, &old_size);
+    } else if (p_mpool->algo == TLSF) {
+        ret_val = k_tlsf_resize(mpid, ptr, size, &old_size);
+    } else if (p_mpool->algo == STACK_POOL) {
+        ret_val = k_spool_resize(mpid, ptr, size, &old_size);
+    } else {
+        ret_val = k_fpool_resize(mpid, ptr, size, &old_size);
+    }
+    
+    if (ret_val == RTX_OK) {
+        return ptr;
+    }
+    if (errno != ENOMEM) {
+        return NULL;
+    }
+    
+    U32 *new_ptr = mpool_alloc(mpid, size);
+    if (new_ptr == NULL) {
+        return NULL;
+    }
+    
+    // both blocks are word aligned and at least this many words long
+    U32 words = (((old_size < size) ? old_size : size) + 3) >> 2;
+    for (U32 i = 0; i < words; i++) {
+        new_ptr[i] = ((U32 *)ptr)[i];
+    }
+    mpool_dealloc(mpid, ptr);
+    
+    return new_ptr;
+}
+
+void *k_mpool_realloc (mpool_t mpid, void *ptr, size_t size)
+{
+#ifdef DEBUG_0
+    printf("k_mpool_realloc: mpid = %d, ptr = 0x%x, size = %d\r\n\r", mpid, ptr, size);
+#endif /* DEBUG_0 */
+    
+    mpid = SEALED_MPID(mpid);
+    void *new_ptr = mpool_realloc(mpid, ptr, size);
+    
+    TRACE_REALLOC(mpid, ptr, size, new_ptr);
+    return new_ptr;
+}
+
+/*
+ *===========================================================================
+ *                             TASK MAGAZINES
+ *===========================================================================
+ */
+
+/*
+ * record or clear the owner of a user heap block, NULL and other pools are ignored
+ */
+static void heap_own(void *ptr, task_t tid)
+{
+	U32 addr = (U32)ptr;
+	
+	if (addr >= RAM1_START && addr <= RAM1_END && tid < MAX_TASKS) {
+		g_heap_owner[(addr - RAM1_START) / OWNER_GRAIN] = tid + 1;
+	}
+}
+
+static void heap_disown(void *ptr)
+{
+	U32 addr = (U32)ptr;
+	
+	if (addr >= RAM1_START && addr <= RAM1_END) {
+		g_heap_owner[(addr - RAM1_START) / OWNER_GRAIN] = 0;
+	}
+}
+
+/*
+ * size class of a request served by the magazines, -1 if it goes straight to the pool
+ */
+static int mag_class(size_t size)
+{
+	if (size == 0 || size > (MIN_BLK_SIZE << (MAG_CLASSES - 1))) {
+		return -1;
+	}
+	
+	U32 used = (size + MIN_BLK_SIZE - 1) & ~(MIN_BLK_SIZE - 1);
+	
+	// a rounded size that is not a power of two is carved to fit, caching it would undo that
+	if ((used & (used - 1)) != 0) {
+		return -1;
+	}
+	return 31 - clz(used) - MIN_POWER;
+}
+
+static void mag_push(BUDDY_POOL *p_pool, MAGAZINE *p_mag, int cls, void *block)
+{
+	*(void **)block = p_mag->head[cls];
+	p_mag->head[cls] = block;
+	p_mag->count[cls]++;
+	flag_set(p_pool->cache_map, (U32)block - RAM1_START, TRUE);
+}
+
+static void *mag_pop(BUDDY_POOL *p_pool, MAGAZINE *p_mag, int cls)
+{
+	void *block = p_mag->head[cls];
+	
+	p_mag->head[cls] = *(void **)block;
+	p_mag->count[cls]--;
+	flag_set(p_pool->cache_map, (U32)block - RAM1_START, FALSE);
+	return block;
+}
+
+/*
+ * returns up to count blocks of a class to the pool, where they can coalesce again
+ */
+static U32 mag_spill(MAGAZINE *p_mag, int cls, U32 count)
+{
+	BUDDY_POOL *p_pool = g_mpools[MPID_IRAM1].ctrl;
+	U32 spilled = 0;
+	
+	for (; spilled < count && p_mag->count[cls] > 0; spilled++) {
+		buddy_dealloc(MPID_IRAM1, p_pool, mag_pop(p_pool, p_mag, cls));
+	}
+	return spilled;
+}
+
+/*
+ * empties every task's magazines, returns the number of blocks given back
+ */
+static U32 mag_drain(void)
+{
+	U32 drained = 0;
+	
+	if (g_mpools[MPID_IRAM1].ctrl == NULL || g_mpools[MPID_IRAM1].algo != BUDDY) {
+		return 0;
+	}
+	for (int tid = 0; tid < MAX_TASKS; tid++) {
+		for (int cls = 0; cls < MAG_CLASSES; cls++) {
+			drained += mag_spill(&g_magazines[tid], cls, MAG_DEPTH);
+		}
+	}
+	return drained;
+}
+
+/*
+ * Function: k_mag_alloc
+ * ----------------------------
+ *
+ *   tid: task the memory is for
+ *   size: bytes requested
+ *
+ *   returns: a block of IRAM1, or NULL if error.
+ *
+ *   Requests that round to 32, 64 or 128 bytes are served from the task's
+ *   magazine, which is refilled MAG_BATCH blocks at a time from the buddy
+ *   allocator. When the pool itself runs out, all magazines are drained
+ *   back into it and the request is retried once, so caching never makes
+ *   an allocation fail that would otherwise succeed. Cached blocks count
+ *   as in use in the pool statistics.
+ *
+ *   With STATIC_ALLOC the user heap is closed once k_mem_seal has run and
+ *   every request fails with EPERM.
+ */
+void *k_mag_alloc(task_t tid, size_t size)
+{
+	MPOOL *p_mpool = &g_mpools[MPID_IRAM1];
+	int cls = mag_class(size);
+	void *block = NULL;
+	
+	if (size == 0) {
+		return NULL;        // as k_mpool_alloc
+	}
+	if (HEAP_SEALED()) {
+		errno = EPERM;
+		return NULL;
+	}
+	if (MAG_DEPTH == 0 || p_mpool->algo != BUDDY || tid >= MAX_TASKS) {
+		block = k_mpool_alloc(MPID_IRAM1, size);
+		heap_own(block, tid);
+		return block;
+	}
+	
+	BUDDY_POOL *p_pool = p_mpool->ctrl;
+	MAGAZINE *p_mag = &g_magazines[tid];
+	
+	if (cls < 0) {
+		block = buddy_alloc(MPID_IRAM1, p_pool, size);
+		if (block == NULL && mag_drain() > 0) {
+			block = buddy_alloc(MPID_IRAM1, p_pool, size);
+		}
+	} else {
+		if (p_mag->count[cls] == 0) {
+			void *batch[MAG_BATCH];
+			int n = 0;
+			
+			for (int retry = 0; n == 0 && retry < 2; retry++) {
+				while (n < MAG_BATCH && (batch[n] = buddy_alloc(MPID_IRAM1, p_pool, MIN_BLK_SIZE << cls)) != NULL) {
+					n++;
+				}
+				if (n == 0 && mag_drain() == 0) {
+					break;
+				}
+			}
+			// push in reverse so blocks come out in the order the pool handed them over
+			while (n > 0) {
+				mag_push(p_pool, p_mag, cls, batch[--n]);
+			}
+		}
+		if (p_mag->count[cls] > 0) {
+			block = mag_pop(p_pool, p_mag, cls);
+		}
+	}
+	
+	if (block == NULL) {
+		errno = ENOMEM;
+		p_mpool->stats.num_failed++;
+	} else {
+		p_mpool->stats.num_alloc++;
+		heap_own(block, tid);
+	}
+	TRACE_ALLOC(MPID_IRAM1, size, block);
+	return block;
+}
+
+/*
+ * Function: k_mag_dealloc
+ * ----------------------------
+ *
+ *   tid: task freeing the memory
+ *   ptr: block from k_mag_alloc or k_mpool_alloc(MPID_IRAM1, ...)
+ *
+ *   returns: 0 if memory is deallocated, or -1 if error.
+ *
+ *   A single 32, 64 or 128 byte block goes into the task's magazine; when
+ *   that is full MAG_BATCH blocks are first spilled back to the pool.
+ *   Anything else is freed straight away.
+ */
+static int mag_dealloc(task_t tid, void *ptr)
+{
+	MPOOL *p_mpool = &g_mpools[MPID_IRAM1];
+	
+	if (MAG_DEPTH == 0 || p_mpool->algo != BUDDY || tid >= MAX_TASKS || ptr == NULL) {
+		return k_mpool_dealloc(MPID_IRAM1, ptr);
+	}
+	
+	BUDDY_POOL *p_pool = p_mpool->ctrl;
+	MAGAZINE *p_mag = &g_magazines[tid];
+	
+	if (!alloc_start(p_pool, RAM1_START, MEM1_POWER, ptr)) {
+		return k_mpool_dealloc(MPID_IRAM1, ptr);    // reports the error
+	}
+	
+	U32 offset = (U32)ptr - RAM1_START;
+	U32 size   = get_block_size(MEM1_POWER, order_get(p_pool->order_map, offset) - 1);
+	U32 next   = offset + size;
+	int cls    = mag_class(size);
+	
+	if (cls < 0 || (next < (1U << MEM1_POWER) && order_get(p_pool->order_map, next) != 0 &&
+	                flag_get(p_pool->tail_map, next))) {
+		return k_mpool_dealloc(MPID_IRAM1, ptr);
+	}
+	
+	if (p_mag->count[cls] >= MAG_DEPTH) {
+		mag_spill(p_mag, cls, MAG_BATCH);
+	}
+	clean_clear(p_pool, offset, size);
+	mag_push(p_pool, p_mag, cls, ptr);
+	p_mpool->stats.num_free++;
+	TRACE_FREE(MPID_IRAM1, ptr);
+	return RTX_OK;
+}
+
+int k_mag_dealloc(task_t tid, void *ptr)
+{
+	int ret_val = mag_dealloc(tid, ptr);
+	
+	if (ret_val == RTX_OK) {
+		heap_disown(ptr);
+	}
+	return ret_val;
+}
+
+/*
+ * returns every block in a task's magazines to the pool, called when the task exits
+ */
+void k_mag_flush(task_t tid)
+{
+	if (tid >= MAX_TASKS || g_mpools[MPID_IRAM1].ctrl == NULL || g_mpools[MPID_IRAM1].algo != BUDDY) {
+		return;
+	}
+	for (int cls = 0; cls < MAG_CLASSES; cls++) {
+		mag_spill(&g_magazines[tid], cls, MAG_DEPTH);
+	}
+}
+
+/*
+ * Function: k_mpool_alloc_n
+ * ----------------------------
+ *
+ *   mpid: Memory Pool ID
+ *   size: bytes per block
+ *   count: number of blocks
+ *   out: receives the count block addresses
+ *
+ *   returns: 0 if all count blocks were allocated, or -1 if error, in which
+ *            case none are.
+ */
+int k_mpool_alloc_n (mpool_t mpid, size_t size, size_t count, void **out)
+{
+    int ret_val = RTX_OK;
+    U32 done = 0;
+    
+#ifdef DEBUG_0
+    printf("k_mpool_alloc_n: mpid = %d, size = %d, count = %d\r\n\r", mpid, size, count);
+#endif /* DEBUG_0 */
+    
+    mpid = SEALED_MPID(mpid);
+    MPOOL *p_mpool = get_mpool(mpid);
+    if (p_mpool == NULL || size == 0) {
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+    if (out == NULL) {
+        errno = EFAULT;
+        return RTX_ERR;
+    }
+    
+    if (p_mpool->algo == BUDDY) {
+        ret_val = buddy_alloc_n(mpid, p_mpool->ctrl, size, count, out);
+    } else {
+        for (; done < count; done++) {
+            out[done] = pool_alloc(mpid, p_mpool->algo, size);
+            if (out[done] == NULL) {
+                ret_val = RTX_ERR;
+                break;
+            }
+        }
+        while (ret_val != RTX_OK && done > 0) {
+            done--;
+            pool_dealloc(mpid, p_mpool->algo, out[done]);
+        }
+    }
+    
+    if (ret_val == RTX_OK) {
+        p_mpool->stats.num_alloc += count;
+#if MEM_TRACE
+        for (done = 0; done < count; done++) {
+            TRACE_ALLOC(mpid, size, out[done]);
+        }
+#endif /* MEM_TRACE */
+    } else {
+        p_mpool->stats.num_failed++;
+    }
+    return ret_val;
+}
+
+/*
+ * Function: k_mpool_dealloc_n
+ * ----------------------------
+ *
+ *   mpid: Memory Pool ID
+ *   ptrs: addresses of the blocks to deallocate
+ *   count: number of addresses
+ *
+ *   returns: 0 if every block is deallocated, or -1 if any address was
+ *            invalid; the valid ones are still deallocated.
+ */
+int k_mpool_dealloc_n (mpool_t mpid, void **ptrs, size_t count)
+{
+    int ret_val = RTX_OK;
+    
+    mpid = SEALED_MPID(mpid);
+    if (get_mpool(mpid) == NULL) {
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+    if (ptrs == NULL) {
+        errno = EFAULT;
+        return RTX_ERR;
+    }
+    
+    for (U32 i = 0; i < count; i++) {
+        if (k_mpool_dealloc(mpid, ptrs[i]) != RTX_OK) {
+            ret_val = RTX_ERR;
+        }
+    }
+    return ret_val;
+}
+
+/*
+ *===========================================================================
+ *                             USER HEAP
+ *===========================================================================
+ */
+
+/*
+ * The user heap system calls that have no magazine path: as k_mpool_realloc,
+ * k_mpool_alloc_n and k_mpool_dealloc_n on IRAM1, keeping the owner map up to
+ * date for the calling task. Once the static plan is sealed they only free.
+ */
+void *k_heap_realloc(task_t tid, void *ptr, size_t size)
+{
+    if (size != 0 && HEAP_SEALED()) {
+        errno = EPERM;
+        return NULL;
+    }
+    
+    void *new_ptr = k_mpool_realloc(MPID_IRAM1, ptr, size);
+    
+    if (size == 0 || (new_ptr != NULL && new_ptr != ptr)) {
+        heap_disown(ptr);
+    }
+    if (new_ptr != ptr) {
+        heap_own(new_ptr, tid);
+    }
+    return new_ptr;
+}
 
-int k_mpool_dump (mpool_t mpid)
+int k_heap_alloc_n(task_t tid, size_t size, size_t count, void **out)
 {
-#ifdef DEBUG_0
-    printf("k_mpool_dump: mpid = %d\r\n", mpid);
-#endif /* DEBUG_0 */
+    if (HEAP_SEALED()) {
+        errno = EPERM;
+        return RTX_ERR;
+    }
+    
+    int ret_val = k_mpool_alloc_n(MPID_IRAM1, size, count, out);
+    
+    for (U32 i = 0; ret_val == RTX_OK && i < count; i++) {
+        heap_own(out[i], tid);
+    }
+    return ret_val;
+}
 
-    int block_count = 0;
+int k_heap_dealloc_n(task_t tid, void **ptrs, size_t count)
+{
+    int ret_val = RTX_OK;
+    
+    if (ptrs == NULL) {
+        errno = EFAULT;
+        return RTX_ERR;
+    }
+    
+    for (U32 i = 0; i < count; i++) {
+        if (k_mpool_dealloc(MPID_IRAM1, ptrs[i]) == RTX_OK) {
+            heap_disown(ptrs[i]);
+        } else {
+            ret_val = RTX_ERR;
+        }
+    }
+    return ret_val;
+}
 
-    if (mpid == MPID_IRAM1) {
+/*
+ * zeroes the first bytes of a new IRAM1 block, skipping what idle time has
+ * already cleared: only the list node of a clean min block is stored to
+ */
+static void heap_zero(void *ptr, U32 bytes)
+{
+    MPOOL *p_mpool = &g_mpools[MPID_IRAM1];
+    U32 *p = ptr;
+    U32 words = (bytes + 3) >> 2;
+    
+    if (p_mpool->algo != BUDDY || ((BUDDY_POOL *)p_mpool->ctrl)->clean_map == NULL) {
+        zero_words(p, words);
+        return;
+    }
+    
+    BUDDY_POOL *p_pool = p_mpool->ctrl;
+    for (U32 offset = (U32)ptr - p_pool->base; words > 0; offset += MIN_BLK_SIZE) {
+        U32 chunk = (words < (MIN_BLK_SIZE >> 2)) ? words : (MIN_BLK_SIZE >> 2);
+        U32 dirty = flag_get(p_pool->clean_map, offset) ? (sizeof(DNODE) >> 2) : chunk;
+        
+        zero_words(p, (dirty < chunk) ? dirty : chunk);
+        p += chunk;
+        words -= chunk;
+    }
+}
 
-        for (int i = MEM1_HEIGHT; i >= 0; i--) {
+/*
+ * Function: k_heap_calloc
+ * ----------------------------
+ *
+ *   tid: task the memory is for
+ *   num: number of elements
+ *   size: bytes per element
+ *
+ *   returns: a zeroed block of num * size bytes of IRAM1, or NULL if error.
+ *
+ *   The block comes from k_mag_alloc like any other user allocation. On a
+ *   buddy IRAM1 the parts the null task already zeroed are not cleared a
+ *   second time, everything else is cleared with word stores.
+ */
+void *k_heap_calloc(task_t tid, size_t num, size_t size)
+{
+    if (size != 0 && num > 0xFFFFFFFF / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    
+    U32 bytes = num * size;
+    void *ptr = k_mag_alloc(tid, bytes);
+    
+    if (ptr != NULL) {
+        heap_zero(ptr, bytes);
+    }
+    return ptr;
+}
 
-            if (free_list_1[i].head) { 
-                DNODE *traverse = free_list_1[i].head;
+/*
+ * returns the bytes the IRAM1 allocator accounts for the block at ptr
+ */
+static U32 heap_block_size(void *ptr)
+{
+    MPOOL *p_mpool = &g_mpools[MPID_IRAM1];
+    
+    if (p_mpool->algo == BUDDY) {
+        BUDDY_POOL *p_pool = p_mpool->ctrl;
+        return buddy_size(p_pool, (U32)ptr - p_pool->base);
+    }
+    return k_tlsf_size(MPID_IRAM1, ptr);
+}
 
-                while (traverse) {
-                    block_count++;
-                    printf("0x%x: 0x%x\n\r", traverse, upow(2, MIN_POWER - i + MEM1_HEIGHT));
-                    traverse = traverse->next;
-                }
-            }
+/*
+ * Function: k_heap_used
+ * ----------------------------
+ *
+ *   tid: task to report on
+ *   p_blocks: receives the number of blocks the task owns, may be NULL
+ *
+ *   returns: the bytes of user heap the task owns, as the pool statistics
+ *            count them.
+ */
+U32 k_heap_used(task_t tid, U32 *p_blocks)
+{
+    U32 bytes  = 0;
+    U32 blocks = 0;
+    
+    for (U32 i = 0; g_mpools[MPID_IRAM1].ctrl != NULL && i < RAM1_SIZE / OWNER_GRAIN; i++) {
+        if (g_heap_owner[i] == tid + 1) {
+            bytes += heap_block_size((void *)(RAM1_START + i * OWNER_GRAIN));
+            blocks++;
         }
     }
-		else if (mpid == MPID_IRAM2)  {
-
-        for (int i = MEM2_HEIGHT; i >= 0; i--) {
+    if (p_blocks != NULL) {
+        *p_blocks = blocks;
+    }
+    return bytes;
+}
 
-            if (free_list_2[i].head) { 
-                DNODE *traverse = free_list_2[i].head;
+/*
+ * Function: k_heap_reclaim
+ * ----------------------------
+ *
+ *   tid: task that is exiting
+ *
+ *   returns: the number of blocks freed.
+ *
+ *   Frees every user heap block the task still owns, in one pass over the
+ *   owner map. A block the task handed to another task without that task
+ *   freeing it is reclaimed as well, so ownership does not move with a
+ *   pointer.
+ */
+int k_heap_reclaim(task_t tid)
+{
+    int count = 0;
+    
+    for (U32 i = 0; g_mpools[MPID_IRAM1].ctrl != NULL && i < RAM1_SIZE / OWNER_GRAIN; i++) {
+        if (g_heap_owner[i] == tid + 1) {
+            k_mpool_dealloc(MPID_IRAM1, (void *)(RAM1_START + i * OWNER_GRAIN));
+            g_heap_owner[i] = 0;
+            count++;
+        }
+    }
+    return count;
+}
 
-                while (traverse) {
-                    block_count++;
-                    printf("0x%x: 0x%x\n\r", traverse, upow(2, MIN_POWER - i + MEM2_HEIGHT));
-                    traverse = traverse->next;
-                }
-            }
+/*
+ * Function: k_mem_idle
+ * ----------------------------
+ *
+ *   Memory upkeep deferred to idle time, run by the null task through
+ *   mem_idle(): coalesces the blocks that buddy pools left uncoalesced,
+ *   then zeroes up to PREZERO_BLOCKS free min blocks of IRAM1 for
+ *   mem_calloc.
+ *
+ *   returns: the amount of work done, 0 if there was nothing to do.
+ */
+int k_mem_idle(void)
+{
+    int work = 0;
+    
+    for (int i = 0; i < NUM_MPOOLS; i++) {
+        if (g_mpools[i].ctrl != NULL && g_mpools[i].algo == BUDDY) {
+            work += buddy_merge(g_mpools[i].ctrl);
         }
     }
-    printf("%d free memory block(s) found\n\r", block_count);
-    return block_count;
+    if (PREZERO_BLOCKS > 0 && g_mpools[MPID_IRAM1].ctrl != NULL && g_mpools[MPID_IRAM1].algo == BUDDY) {
+        work += buddy_prezero(g_mpools[MPID_IRAM1].ctrl, PREZERO_BLOCKS);
+    }
+    return work;
 }
 
-int bottom_up(mpool_t mpid, U8 level)
-{	
-		for (int i = level; i >= 0; --i) {
-			if (mpid == MPID_IRAM1 && free_list_1[i].head) {
-					return level;
-			}
-			if (mpid == MPID_IRAM2 && free_list_2[i].head) {
-					return level;
-			}
-		}
+int k_mpool_dump (mpool_t mpid)
+{
+    MPOOL *p_mpool = get_mpool(mpid);
+    
+#ifdef DEBUG_0
+    printf("k_mpool_dump: mpid = %d\r\n", mpid);
+#endif /* DEBUG_0 */
+
+    if (p_mpool == NULL) {
+        printf("0 free memory block(s) found\n\r");
+        return 0;
+    }
+    if (mpid == MPID_IRAM1) {
+        mag_drain();    // show cached blocks as the free space they really are
+    }
+    if (p_mpool->algo == BUDDY) {
+        return buddy_dump(p_mpool->ctrl);
+    }
+    if (p_mpool->algo == TLSF) {
+        return k_tlsf_dump(mpid);
+    }
+    if (p_mpool->algo == STACK_POOL) {
+        return k_spool_dump(mpid);
+    }
+    return k_fpool_dump(mpid);
+}
+
+/*
+ * Function: k_mpool_used
+ * ----------------------------
+ *
+ *   Called by the allocators with the bytes a pool gained (> 0) or lost (< 0)
+ *   so that in_use and its high-water mark stay current.
+ */
+void k_mpool_used(mpool_t mpid, int bytes)
+{
+    MEM_STATS *p_stats = &g_mpools[mpid].stats;
+    
+    p_stats->in_use += bytes;
+    if (p_stats->in_use > p_stats->peak) {
+        p_stats->peak = p_stats->in_use;
+    }
+}
+
+/*
+ * Function: k_mpool_free_blocks
+ * ----------------------------
+ *
+ *   Adds count free blocks of size bytes to the free space fields of out.
+ */
+void k_mpool_free_blocks(MEM_STATS *out, U32 size, U32 count)
+{
+    int order = (int)(31 - clz(size)) - MIN_POWER;
+    
+    if (count == 0) {
+        return;
+    }
+    order = (order < 0) ? 0 : order;
+    order = (order >= MEM_ORDERS) ? MEM_ORDERS - 1 : order;
+    
+    out->free += size * count;
+    out->free_blocks[order] += count;
+    if (size > out->largest_free) {
+        out->largest_free = size;
+    }
+}
+
+/*
+ * Function: k_mpool_stats
+ * ----------------------------
+ *
+ *   mpid: Memory Pool ID
+ *   out: buffer to fill
+ *
+ *   returns: 0 on success, or -1 if error.
+ *
+ *   The counters are kept up to date by alloc and free; only the free block
+ *   fields are gathered here, by walking the pool's free lists.
+ */
+int k_mpool_stats(mpool_t mpid, MEM_STATS *out)
+{
+    MPOOL *p_mpool = get_mpool(mpid);
+    
+    if (out == NULL) {
+        errno = EFAULT;
+        return RTX_ERR;
+    }
+    if (p_mpool == NULL) {
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+    
+    *out = p_mpool->stats;
+    out->free = 0;
+    out->largest_free = 0;
+    for (int i = 0; i < MEM_ORDERS; i++) {
+        out->free_blocks[i] = 0;
+    }
+    
+    if (p_mpool->algo == BUDDY) {
+        buddy_stats(p_mpool->ctrl, out);
+    } else if (p_mpool->algo == TLSF) {
+        k_tlsf_stats(mpid, out);
+    } else if (p_mpool->algo == STACK_POOL) {
+        k_spool_stats(mpid, out);
+    } else {
+        k_fpool_stats(mpid, out);
+    }
+    
+    out->frag = (out->free == 0) ? 0 : 100 - (out->largest_free * 100) / out->free;
+    return RTX_OK;
+}
 
-    return -1;  
+/*
+ * Function: k_mem_is_reserved
+ * ----------------------------
+ *
+ *   returns: TRUE if no pool can hand out any byte of [start, end], i.e. the
+ *            range is inside one allocation of the innermost pool holding it,
+ *            or inside the unmanaged IRAM1 space between the OS image and RAM1_START.
+ */
+BOOL k_mem_is_reserved(U32 start, U32 end)
+{
+	if (end < start) {
+		return FALSE;
+	}
+	
+	MPOOL *p_mpool = innermost_mpool(start, end);
+	if (p_mpool == NULL) {
+		return (start >= RAM1_START_RT && end < RAM1_START);
+	}
+	
+	mpool_t mpid = p_mpool - g_mpools;
+	if (p_mpool->algo == BUDDY) {
+		return buddy_is_reserved(p_mpool->ctrl, start, end);
+	}
+	if (p_mpool->algo == TLSF) {
+		return k_tlsf_is_reserved(mpid, start, end);
+	}
+	if (p_mpool->algo == STACK_POOL) {
+		return k_spool_is_reserved(mpid, start, end);
+	}
+	return k_fpool_is_reserved(mpid, start, end);
 }
  
+/*
+ * Function: k_mem_init
+ * ----------------------------
+ *
+ *   Creates the IRAM1 and IRAM2 pools with the given algorithm and, when
+ *   MBX_POOL_SIZE is set, a buddy sub-pool of IRAM2 for mailbox buffers so
+ *   that short-lived messages do not fragment the space used by stacks.
+ *   When STACK_POOL_SIZE is set, task stacks get a STACK_POOL of their own
+ *   in IRAM2 so they are not rounded up to powers of two.
+ */
 int k_mem_init(int algo)
 {
 #ifdef DEBUG_0
     printf("k_mem_init: algo = %d\r\n\r", algo);
 #endif /* DEBUG_0 */
         
+    for (int i = 0; i < NUM_MPOOLS; i++) {
+        g_mpools[i].ctrl = NULL;
+    }
+    for (int tid = 0; tid < MAX_TASKS; tid++) {
+        for (int cls = 0; cls < MAG_CLASSES; cls++) {
+            g_magazines[tid].head[cls]  = NULL;
+            g_magazines[tid].count[cls] = 0;
+        }
+    }
+    for (int i = 0; i < RAM1_SIZE / OWNER_GRAIN; i++) {
+        g_heap_owner[i] = 0;
+    }
+    g_mbx_mpid = MPID_IRAM2;
+    g_stack_mpid = MPID_IRAM2;
+#if STATIC_ALLOC
+    MEM_SLOT empty_slot = {0};
+    for (int tid = 0; tid < MAX_TASKS; tid++) {
+        g_mem_slots[tid] = empty_slot;
+    }
+    g_mem_sealed = FALSE;
+    g_buf_mpid = MPID_IRAM2;
+#endif
+    
     if ( k_mpool_create(algo, RAM1_START, RAM1_END) < 0 ) {
         return RTX_ERR;
     }
@@ -444,30 +2069,82 @@ int k_mem_init(int algo)
         return RTX_ERR;
     }
     
+#if STACK_POOL_SIZE > 0
+    U32 stacks = (U32)mpool_alloc(MPID_IRAM2, STACK_POOL_SIZE);
+    if (stacks == 0) {
+        return RTX_ERR;
+    }
+    g_stack_mpid = k_mpool_create(STACK_POOL, stacks, stacks + STACK_POOL_SIZE - 1);
+    if (g_stack_mpid < 0) {
+        return RTX_ERR;
+    }
+#endif
+    
+#if MBX_POOL_SIZE > 0
+    U32 region = (U32)mpool_alloc(MPID_IRAM2, MBX_POOL_SIZE);
+    if (region == 0) {
+        return RTX_ERR;
+    }
+    g_mbx_mpid = k_mpool_create(BUDDY, region, region + MBX_POOL_SIZE - 1);
+    if (g_mbx_mpid < 0) {
+        return RTX_ERR;
+    }
+#endif
+    
     return RTX_OK;
 }
 
 /**
  * @brief allocate kernel stack statically
+ * @note  with SHARED_K_STACK the first call allocates the one kernel stack
+ *        and every later call returns the same base
  */
 U32* k_alloc_k_stack(task_t tid)
 {   
-    U32 *sp = k_mpool_alloc(MPID_IRAM2, KERN_STACK_SIZE);
+#if STATIC_ALLOC
+    if (g_mem_sealed) {
+        return (U32 *)g_mem_slots[tid].k_stack;
+    }
+#endif
+#if SHARED_K_STACK
+    static U32 *shared_sp = NULL;
+
+    if (shared_sp != NULL) {
+        return shared_sp;
+    }
+#endif
+    U32 *sp = k_alloc_p_stack(tid, KERN_STACK_SIZE);
 	  if (sp == NULL) {
       return NULL;
     }
-    sp = (U32*) ((U32)sp + KERN_STACK_SIZE);
+#if SHARED_K_STACK
+    shared_sp = sp;
+#endif
     
     return sp;
 }
 
 /**
  * @brief allocate user/process stack dynamically
+ * @note  taken from the stack pool, or from IRAM2 once the stack pool is full.
+ *        With STATIC_ALLOC, once sealed it is the stack reserved for tid
  */
 
 U32* k_alloc_p_stack(task_t tid, U32 task_size)
 {
-    U32 *sp = k_mpool_alloc(MPID_IRAM2, task_size);
+#if STATIC_ALLOC
+    if (g_mem_sealed) {
+        if (task_size > g_mem_slots[tid].u_size) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        return (U32 *)g_mem_slots[tid].u_stack;
+    }
+#endif
+    U32 *sp = k_mpool_alloc(g_stack_mpid, task_size);
+    if (sp == NULL && g_stack_mpid != MPID_IRAM2) {
+      sp = k_mpool_alloc(MPID_IRAM2, task_size);
+    }
     if (sp == NULL) {
       return NULL;
     }
@@ -476,6 +2153,150 @@ U32* k_alloc_p_stack(task_t tid, U32 task_size)
     return sp;
 }
 
+/**
+ * @brief free a stack from either allocator above, given its base and size
+ */
+int k_dealloc_stack(U32 sp_base, U32 size)
+{
+#if STATIC_ALLOC
+    if (g_mem_sealed) {
+        return RTX_OK;      // the stack stays reserved for its TID
+    }
+#endif
+    U32 start = sp_base - size;
+    MPOOL *p_mpool = innermost_mpool(start, sp_base - 1);
+    
+    if (p_mpool == NULL) {
+      errno = EFAULT;
+      return RTX_ERR;
+    }
+    return k_mpool_dealloc(p_mpool - g_mpools, (void *)start);
+}
+
+/**
+ * @brief allocate a mailbox buffer for tid, the one reserved for it once sealed
+ */
+void *k_alloc_mbx(task_t tid, size_t size)
+{
+#if STATIC_ALLOC
+    if (g_mem_sealed) {
+        if (size > g_mem_slots[tid].mbx_size) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        return g_mem_slots[tid].mbx;
+    }
+#endif
+    return k_mpool_alloc(g_mbx_mpid, size);
+}
+
+/**
+ * @brief free a mailbox buffer from k_alloc_mbx
+ */
+int k_dealloc_mbx(task_t tid, void *buf)
+{
+#if STATIC_ALLOC
+    if (g_mem_sealed) {
+        return RTX_OK;
+    }
+#endif
+    return k_mpool_dealloc(g_mbx_mpid, buf);
+}
+
+/*
+ *===========================================================================
+ *                             STATIC PLAN
+ *===========================================================================
+ */
+#if STATIC_ALLOC
+
+/*
+ * Function: k_mem_reserve
+ * ----------------------------
+ *
+ *   tid: task the memory is kept for
+ *   u_size: user stack size, 0 for none
+ *   mbx_size: mailbox size, 0 for none
+ *
+ *   returns: 0 on success, or -1 if the plan is sealed or does not fit.
+ *
+ *   Takes a kernel stack and the given user stack and mailbox for tid from
+ *   the usual pools. k_alloc_p_stack, k_alloc_k_stack and k_alloc_mbx hand
+ *   them out once k_mem_seal has run.
+ */
+int k_mem_reserve(task_t tid, U32 u_size, U32 mbx_size)
+{
+    if (g_mem_sealed || tid >= MAX_TASKS) {
+        errno = EPERM;
+        return RTX_ERR;
+    }
+    MEM_SLOT *p_slot = &g_mem_slots[tid];
+    
+    if (u_size > 0) {
+        p_slot->u_stack = (U32)k_alloc_p_stack(tid, u_size);
+        if (p_slot->u_stack == 0) {
+            errno = ENOMEM;
+            return RTX_ERR;
+        }
+        p_slot->u_size = u_size;
+    }
+    
+    p_slot->k_stack = (U32)k_alloc_k_stack(tid);
+    if (p_slot->k_stack == 0) {
+        errno = ENOMEM;
+        return RTX_ERR;
+    }
+    
+    if (mbx_size > 0) {
+        p_slot->mbx = k_mpool_alloc(g_mbx_mpid, mbx_size);
+        if (p_slot->mbx == NULL) {
+            errno = ENOMEM;
+            return RTX_ERR;
+        }
+        p_slot->mbx_size = mbx_size;
+    }
+    return RTX_OK;
+}
+
+/*
+ * Function: k_mem_seal
+ * ----------------------------
+ *
+ *   returns: 0 on success, or -1 if the kernel buffers do not fit.
+ *
+ *   Sets STATIC_BUF_COUNT kernel buffers of STATIC_BUF_SIZE bytes aside in
+ *   IRAM2 and ends the plan. From here on k_mpool_alloc on MPID_IRAM2 takes
+ *   one of those buffers in O(1).
+ */
+int k_mem_seal(void)
+{
+    U32 map = ((STATIC_BUF_COUNT + 31) >> 5) << 2;
+    U32 size = sizeof(FPOOL) + map + STATIC_BUF_COUNT * ((STATIC_BUF_SIZE + 7) & ~7U) + 16;
+    U32 region = (U32)mpool_alloc(MPID_IRAM2, size);
+    
+    if (region == 0) {
+        errno = ENOMEM;
+        return RTX_ERR;
+    }
+    g_buf_mpid = k_mpool_create_fixed(region, region + size - 1, STATIC_BUF_SIZE);
+    if (g_buf_mpid < 0) {
+        g_buf_mpid = MPID_IRAM2;
+        return RTX_ERR;
+    }
+    g_mem_sealed = TRUE;
+    return RTX_OK;
+}
+
+/*
+ * returns TRUE if the stack reserved for tid holds u_size bytes
+ */
+BOOL k_mem_slot_fits(task_t tid, U32 u_size)
+{
+    return !g_mem_sealed || u_size <= g_mem_slots[tid].u_size;
+}
+
+#endif /* STATIC_ALLOC */
+
 /*
  *===========================================================================
  *                             END OF FILE
@@ -27,6 +27,43 @@
 #define K_MEM_H_
 #include "k_inc.h"
 #include "lpc1768_mem.h"        // board memory map
+#include "mem_stats.h"
+
+/*
+ * ------------------------------------------------------------------------
+ *                             TYPEDEFS
+ * ------------------------------------------------------------------------
+ */
+#define MAX_BUDDY_HEIGHT    MEM2_HEIGHT     // deepest tree a buddy pool may have
+#define LAZY_SLOTS          ((LAZY_WATERMARK > 0) ? LAZY_WATERMARK : 1)
+
+typedef struct buddy_pool {
+    U32     base;                           // address of the root block
+    U8      power;                          // log2 of the pool size
+    U8      height;                         // power - MIN_POWER
+    U32     reserved;                       // bytes at base holding this struct and its maps
+    U32     free_map;                       // bit i set if free_list[i] is not empty
+    DLIST   free_list[MAX_BUDDY_HEIGHT + 1];
+    U8     *bit_tree;                       // set bit: node allocated or split
+    U8     *order_map;                      // level + 1 of the block starting at each min block
+    U8     *tail_map;                       // set bit: min block starts a tail of an allocation
+    U8     *cache_map;                      // set bit: block sits in a magazine, NULL if never cached
+    U8     *clean_map;                      // set bit: free min block is zero past its list node, NULL if never pre-zeroed
+    U32     lazy_count;                     // blocks freed without coalescing
+    U16     lazy[LAZY_SLOTS];               // their offsets in min blocks
+} BUDDY_POOL;
+
+typedef struct mpool {
+    void       *ctrl;                       // control block of the allocator, NULL if unused
+    int         algo;                       // BUDDY, TLSF or FIXED_POOL
+    U32         start;                      // first byte of the region
+    U32         end;                        // last byte of the region
+    MEM_STATS   stats;                      // counters, free space is filled in by k_mpool_stats
+} MPOOL;
+
+extern MPOOL    g_mpools[NUM_MPOOLS];
+extern mpool_t  g_mbx_mpid;
+extern mpool_t  g_stack_mpid;
 
 /*
  * ------------------------------------------------------------------------
@@ -37,13 +74,39 @@
 mpool_t k_mpool_create  (int algo, U32 strat, U32 end);
 void   *k_mpool_alloc   (mpool_t mpid, size_t size);
 int     k_mpool_dealloc (mpool_t mpid, void *ptr);
+void   *k_mpool_realloc (mpool_t mpid, void *ptr, size_t size);
+int     k_mpool_alloc_n (mpool_t mpid, size_t size, size_t count, void **out);
+int     k_mpool_dealloc_n(mpool_t mpid, void **ptrs, size_t count);
 int     k_mpool_dump    (mpool_t mpid);
+int     k_mpool_stats   (mpool_t mpid, MEM_STATS *out);
 
 int     k_mem_init      (int algo);
 U32    *k_alloc_k_stack (task_t tid);
 U32    *k_alloc_p_stack (task_t tid, U32 task_size);
+int     k_dealloc_stack (U32 sp_base, U32 size);
+void   *k_alloc_mbx     (task_t tid, size_t size);
+int     k_dealloc_mbx   (task_t tid, void *buf);
 // declare newly added functions here
-int bottom_up(mpool_t mpid, U8 level);
+mpool_t k_mpool_create_fixed(U32 start, U32 end, size_t obj_size);
+void   *k_mag_alloc     (task_t tid, size_t size);
+int     k_mag_dealloc   (task_t tid, void *ptr);
+void    k_mag_flush     (task_t tid);
+void   *k_heap_realloc  (task_t tid, void *ptr, size_t size);
+int     k_heap_alloc_n  (task_t tid, size_t size, size_t count, void **out);
+int     k_heap_dealloc_n(task_t tid, void **ptrs, size_t count);
+void   *k_heap_calloc   (task_t tid, size_t num, size_t size);
+U32     k_heap_used     (task_t tid, U32 *p_blocks);
+int     k_heap_reclaim  (task_t tid);
+int     k_mem_idle      (void);
+int bottom_up(BUDDY_POOL *p_pool, U8 level);
+BOOL    k_mem_is_reserved(U32 start, U32 end);
+#if STATIC_ALLOC
+int     k_mem_reserve   (task_t tid, U32 u_size, U32 mbx_size);
+int     k_mem_seal      (void);
+BOOL    k_mem_slot_fits (task_t tid, U32 u_size);
+#endif
+void    k_mpool_used    (mpool_t mpid, int bytes);
+void    k_mpool_free_blocks(MEM_STATS *out, U32 size, U32 count);
 
 /*
  * ------------------------------------------------------------------------
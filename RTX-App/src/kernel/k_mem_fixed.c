@@ -0,0 +1,247 @@
+/*
+ ****************************************************************************
+ *
+ *                  UNIVERSITY OF WATERLOO ECE 350 RTOS LAB
+ *
+ *                     Copyright 2020-2022 Yiqing Huang
+ *
+ *          This software is subject to an open source license and
+ *          may be freely redistributed under the terms of MIT License.
+ ****************************************************************************
+ */
+
+/**************************************************************************//**
+ * @file        k_mem_fixed.c
+ * @brief       Fixed-size (FIXED_POOL) Memory Pool C Code
+ *
+ * @details     A fixed pool hands out equal-sized objects from an intrusive
+ *              LIFO free list, so alloc and free are O(1) with no rounding
+ *              beyond 8-byte alignment. The allocation bitmap lives at the
+ *              front of the pool's own range and is only used to reject
+ *              frees of objects that are not allocated.
+ *
+ *              Layout of a pool made over [start, end]:
+ *
+ *              start (8-byte aligned)-->+---------------------------+
+ *                                       |  alloc_map, 1 bit/object  |
+ *                               objs -->|---------------------------|
+ *                                       |  object 0                 |
+ *                                       |  object 1                 |
+ *                                       |  ...                      |
+ *                                       |  object num_objs - 1      |
+ *                                       |---------------------------|
+ *                                       |  unused tail              |
+ *                                 end-->+---------------------------+
+ *
+ *****************************************************************************/
+
+#include "k_inc.h"
+#include "k_mem.h"
+#include "k_mem_fixed.h"
+
+/*
+ *===========================================================================
+ *                            FUNCTIONS
+ *===========================================================================
+ */
+
+static FPOOL *get_fpool(mpool_t mpid)
+{
+    return (FPOOL *)g_mpools[mpid].ctrl;
+}
+
+/*
+ * Function: k_fpool_create
+ * ----------------------------
+ *
+ *   p_pool: control block to set up
+ *   start: first byte of the range
+ *   end: last byte of the range
+ *   obj_size: object size in bytes, rounded up to a multiple of 8
+ *
+ *   returns: 0 on success, or -1 if the range cannot hold a single object.
+ */
+int k_fpool_create(FPOOL *p_pool, U32 start, U32 end, size_t obj_size)
+{
+#ifdef DEBUG_0
+    printf("k_fpool_create: [0x%x, 0x%x], obj_size = %u\r\n", start, end, obj_size);
+#endif /* DEBUG_0 */
+
+    if (obj_size == 0 || end <= start) {
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+    
+    // objects are 8-byte aligned and must hold the free list link
+    obj_size = (obj_size + 7) & ~7U;
+    if (obj_size < sizeof(void *)) {
+        obj_size = sizeof(void *);
+    }
+    
+    // size the bitmap for the most objects that could fit, then fit the objects after it
+    U32 base  = (start + 7) & ~7U;
+    U32 limit = end + 1;
+    if (base >= limit) {
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+    U32 max_objs  = ((limit - base) * 8) / (obj_size * 8 + 1);
+    U32 map_words = (max_objs + 31) >> 5;
+    U32 objs      = (base + (map_words << 2) + 7) & ~7U;
+    U32 num_objs  = (objs < limit) ? (limit - objs) / obj_size : 0;
+    
+    if (num_objs > (map_words << 5)) {
+        num_objs = map_words << 5;
+    }
+    if (num_objs == 0) {
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+    
+    p_pool->obj_size  = obj_size;
+    p_pool->num_objs  = num_objs;
+    p_pool->num_free  = num_objs;
+    p_pool->start     = start;
+    p_pool->end       = end;
+    p_pool->objs      = (U8 *)objs;
+    p_pool->alloc_map = (U32 *)base;
+    
+    for (U32 i = 0; i < map_words; i++) {
+        p_pool->alloc_map[i] = 0;
+    }
+    
+    // thread the free list in address order
+    p_pool->free_head = NULL;
+    for (U32 i = num_objs; i > 0; i--) {
+        void **obj = (void **)(p_pool->objs + (i - 1) * obj_size);
+        *obj = p_pool->free_head;
+        p_pool->free_head = obj;
+    }
+    
+    return RTX_OK;
+}
+
+void *k_fpool_alloc(mpool_t mpid, size_t size)
+{
+    FPOOL *p_pool = get_fpool(mpid);
+    
+    if (size > p_pool->obj_size) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (p_pool->free_head == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    
+    void **obj = (void **)p_pool->free_head;
+    p_pool->free_head = *obj;
+    p_pool->num_free--;
+    k_mpool_used(mpid, p_pool->obj_size);
+    
+    U32 index = ((U8 *)obj - p_pool->objs) / p_pool->obj_size;
+    p_pool->alloc_map[index >> 5] |= BIT(index & 0x1F);
+    
+    return obj;
+}
+
+/*
+ * returns the index of the allocated object at ptr, or -1 if ptr is outside
+ * the pool, not on an object boundary, or not allocated (double free)
+ */
+static int obj_index(FPOOL *p_pool, void *ptr)
+{
+    U32 offset = (U8 *)ptr - p_pool->objs;
+    U32 index  = offset / p_pool->obj_size;
+    
+    if ((U8 *)ptr < p_pool->objs || index >= p_pool->num_objs ||
+        index * p_pool->obj_size != offset ||
+        !(p_pool->alloc_map[index >> 5] & BIT(index & 0x1F))) {
+        return -1;
+    }
+    return index;
+}
+
+int k_fpool_dealloc(mpool_t mpid, void *ptr)
+{
+    FPOOL *p_pool = get_fpool(mpid);
+    
+    if (ptr == NULL) {
+        return RTX_OK;
+    }
+    
+    int index = obj_index(p_pool, ptr);
+    
+    if (index < 0) {
+        errno = EFAULT;
+        return RTX_ERR;
+    }
+    
+    p_pool->alloc_map[index >> 5] &= ~BIT(index & 0x1F);
+    *(void **)ptr = p_pool->free_head;
+    p_pool->free_head = ptr;
+    p_pool->num_free++;
+    k_mpool_used(mpid, -(int)p_pool->obj_size);
+    
+    return RTX_OK;
+}
+
+/*
+ * objects cannot change size, so a resize only succeeds if the object is already large enough
+ */
+int k_fpool_resize(mpool_t mpid, void *ptr, size_t size, U32 *p_old)
+{
+    FPOOL *p_pool = get_fpool(mpid);
+    
+    if (obj_index(p_pool, ptr) < 0) {
+        errno = EFAULT;
+        return RTX_ERR;
+    }
+    *p_old = p_pool->obj_size;
+    if (size > p_pool->obj_size) {
+        errno = ENOMEM;
+        return RTX_ERR;
+    }
+    return RTX_OK;
+}
+
+int k_fpool_dump(mpool_t mpid)
+{
+    FPOOL *p_pool = get_fpool(mpid);
+    int block_count = 0;
+    
+    for (void **obj = p_pool->free_head; obj != NULL; obj = *obj) {
+        block_count++;
+        printf("0x%x: 0x%x\n\r", obj, p_pool->obj_size);
+    }
+    printf("%d free memory block(s) found\n\r", block_count);
+    return block_count;
+}
+
+void k_fpool_stats(mpool_t mpid, MEM_STATS *out)
+{
+    FPOOL *p_pool = get_fpool(mpid);
+    k_mpool_free_blocks(out, p_pool->obj_size, p_pool->num_free);
+}
+
+/*
+ * returns TRUE if [start, end] lies inside one allocated object
+ */
+BOOL k_fpool_is_reserved(mpool_t mpid, U32 start, U32 end)
+{
+    FPOOL *p_pool = get_fpool(mpid);
+    
+    if (start < (U32)p_pool->objs) {
+        return FALSE;
+    }
+    U32 index = (start - (U32)p_pool->objs) / p_pool->obj_size;
+    return index < p_pool->num_objs &&
+           (p_pool->alloc_map[index >> 5] & BIT(index & 0x1F)) &&
+           end < (U32)p_pool->objs + (index + 1) * p_pool->obj_size;
+}
+
+/*
+ *===========================================================================
+ *                             END OF FILE
+ *===========================================================================
+ */
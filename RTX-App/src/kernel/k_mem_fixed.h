@@ -0,0 +1,65 @@
+/*
+ ****************************************************************************
+ *
+ *                  UNIVERSITY OF WATERLOO ECE 350 RTOS LAB
+ *
+ *                     Copyright 2020-2022 Yiqing Huang
+ *
+ *          This software is subject to an open source license and
+ *          may be freely redistributed under the terms of MIT License.
+ ****************************************************************************
+ */
+
+/**************************************************************************//**
+ * @file        k_mem_fixed.h
+ * @brief       Fixed-size (FIXED_POOL) Memory Pool Header File
+ *
+ * @note        Created through k_mpool_create(FIXED_POOL, ...) or
+ *              k_mpool_create_fixed(), which take a descriptor slot and
+ *              check the range; these functions only manage the objects.
+ *
+ *****************************************************************************/
+
+#ifndef K_MEM_FIXED_H_
+#define K_MEM_FIXED_H_
+#include "k_inc.h"
+#include "mem_stats.h"
+
+/*
+ *===========================================================================
+ *                             STRUCTURES
+ *===========================================================================
+ */
+
+typedef struct fpool {
+    U32         obj_size;       /**< object size in bytes                           */
+    U32         num_objs;       /**< number of objects in the pool                  */
+    U32         num_free;       /**< number of objects on the free list             */
+    U32         start;          /**< first byte of the range the pool was made over */
+    U32         end;            /**< last byte of the range the pool was made over  */
+    U8          *objs;          /**< address of the first object                    */
+    U32         *alloc_map;     /**< one bit per object, set while allocated        */
+    void        *free_head;     /**< free objects, linked through their first word  */
+} FPOOL;
+
+/*
+ * ------------------------------------------------------------------------
+ *                             FUNCTION PROTOTYPES
+ * ------------------------------------------------------------------------
+ */
+
+int     k_fpool_create  (FPOOL *p_pool, U32 start, U32 end, size_t obj_size);
+void   *k_fpool_alloc   (mpool_t mpid, size_t size);
+int     k_fpool_dealloc (mpool_t mpid, void *ptr);
+int     k_fpool_resize  (mpool_t mpid, void *ptr, size_t size, U32 *p_old);
+int     k_fpool_dump    (mpool_t mpid);
+void    k_fpool_stats   (mpool_t mpid, MEM_STATS *out);
+BOOL    k_fpool_is_reserved(mpool_t mpid, U32 start, U32 end);
+
+#endif // ! K_MEM_FIXED_H_
+
+/*
+ *===========================================================================
+ *                             END OF FILE
+ *===========================================================================
+ */
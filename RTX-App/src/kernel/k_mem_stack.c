@@ -0,0 +1,310 @@
+/*
+ ****************************************************************************
+ *
+ *                  UNIVERSITY OF WATERLOO ECE 350 RTOS LAB
+ *
+ *                     Copyright 2020-2022 Yiqing Huang
+ *
+ *          This software is subject to an open source license and
+ *          may be freely redistributed under the terms of MIT License.
+ ****************************************************************************
+ */
+
+/**************************************************************************//**
+ * @file        k_mem_stack.c
+ * @brief       Stack Region (STACK_POOL) Memory Pool C Code
+ *
+ * @details     A stack pool tiles its range with extents, each starting with
+ *              an SBLOCK header. Sizes are only rounded up to 8 bytes, so a
+ *              0x600 byte stack takes 0x600 bytes plus its header instead of
+ *              the 0x800 a buddy pool would give it.
+ *
+ *              Free extents are kept in address order. An allocation takes
+ *              the highest extent that fits and carves the block off its top,
+ *              so stacks pack down from the top of the range and the free
+ *              space stays together at the bottom. Freeing merges an extent
+ *              with free neighbours on either side.
+ *
+ *              The link word of an allocated extent holds SPOOL_MAGIC. A stack
+ *              that overflows writes over the header below it, and the free
+ *              of that stack is then rejected instead of corrupting the list.
+ *
+ *              Layout of a pool made over [start, end]:
+ *
+ *              start (8-byte aligned)-->+---------------------------+
+ *                                       |  free extents             |
+ *                                       |---------------------------|
+ *                                       |  header | stack n         |
+ *                                       |  ...                      |
+ *                                       |  header | stack 0         |
+ *                                end -->+---------------------------+
+ *
+ *****************************************************************************/
+
+#include "k_inc.h"
+#include "k_mem.h"
+#include "k_mem_stack.h"
+
+#define MIN_EXTENT  (sizeof(SBLOCK) + SPOOL_ALIGN)     /* smallest remainder worth splitting off */
+
+/*
+ *===========================================================================
+ *                            FUNCTIONS
+ *===========================================================================
+ */
+
+static SPOOL *get_spool(mpool_t mpid)
+{
+    return (SPOOL *)g_mpools[mpid].ctrl;
+}
+
+/*
+ * returns the extent size for a size byte payload
+ */
+static U32 extent_size(size_t size)
+{
+    return ((size + SPOOL_ALIGN - 1) & ~(SPOOL_ALIGN - 1)) + sizeof(SBLOCK);
+}
+
+/*
+ * returns the allocated extent whose payload starts at ptr, or NULL if there is none
+ */
+static SBLOCK *alloc_block(SPOOL *p_pool, void *ptr)
+{
+    SBLOCK *blk = (SBLOCK *)ptr - 1;
+
+    if ((U32)blk < p_pool->base || (U32)ptr >= p_pool->limit ||
+        ((U32)ptr & (SPOOL_ALIGN - 1)) != 0 || blk->next != (SBLOCK *)SPOOL_MAGIC) {
+        return NULL;
+    }
+    return blk;
+}
+
+/*
+ * puts blk on the free list in address order and merges it with free neighbours
+ */
+static void free_insert(SPOOL *p_pool, SBLOCK *blk)
+{
+    SBLOCK *prev = NULL;
+    SBLOCK *next = p_pool->free_head;
+
+    while (next != NULL && next < blk) {
+        prev = next;
+        next = next->next;
+    }
+
+    if (next != NULL && (U32)blk + blk->size == (U32)next) {
+        blk->size += next->size;
+        next = next->next;
+    }
+    blk->next = next;
+
+    if (prev == NULL) {
+        p_pool->free_head = blk;
+    } else if ((U32)prev + prev->size == (U32)blk) {
+        prev->size += blk->size;
+        prev->next = next;
+    } else {
+        prev->next = blk;
+    }
+}
+
+/*
+ * Function: k_spool_create
+ * ----------------------------
+ *
+ *   p_pool: control block to set up
+ *   start: first byte of the range
+ *   end: last byte of the range
+ *
+ *   returns: 0 on success, or -1 if the range cannot hold a single extent.
+ */
+int k_spool_create(SPOOL *p_pool, U32 start, U32 end)
+{
+#ifdef DEBUG_0
+    printf("k_spool_create: [0x%x, 0x%x]\r\n", start, end);
+#endif /* DEBUG_0 */
+
+    U32 base  = (start + SPOOL_ALIGN - 1) & ~(SPOOL_ALIGN - 1);
+    U32 limit = (end + 1) & ~(SPOOL_ALIGN - 1);
+
+    if (end <= start || base >= limit || limit - base < MIN_EXTENT) {
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+
+    p_pool->start     = start;
+    p_pool->end       = end;
+    p_pool->base      = base;
+    p_pool->limit     = limit;
+    p_pool->free_head = (SBLOCK *)base;
+    p_pool->free_head->size = limit - base;
+    p_pool->free_head->next = NULL;
+
+    return RTX_OK;
+}
+
+void *k_spool_alloc(mpool_t mpid, size_t size)
+{
+    SPOOL *p_pool = get_spool(mpid);
+    SBLOCK **p_fit = NULL;
+
+    if (size > p_pool->limit - p_pool->base) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    U32 need = extent_size(size);
+
+    // the list is in address order, so the last fit is the highest one
+    for (SBLOCK **p_link = &p_pool->free_head; *p_link != NULL; p_link = &(*p_link)->next) {
+        if ((*p_link)->size >= need) {
+            p_fit = p_link;
+        }
+    }
+    if (p_fit == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    SBLOCK *ext = *p_fit;
+    SBLOCK *blk = ext;
+    if (ext->size - need >= MIN_EXTENT) {
+        ext->size -= need;
+        blk = (SBLOCK *)((U32)ext + ext->size);
+    } else {
+        *p_fit = ext->next;
+        need = ext->size;
+    }
+
+    blk->size = need;
+    blk->next = (SBLOCK *)SPOOL_MAGIC;
+    k_mpool_used(mpid, need);
+
+    return blk + 1;
+}
+
+int k_spool_dealloc(mpool_t mpid, void *ptr)
+{
+    SPOOL *p_pool = get_spool(mpid);
+
+    if (ptr == NULL) {
+        return RTX_OK;
+    }
+
+    SBLOCK *blk = alloc_block(p_pool, ptr);
+
+    if (blk == NULL) {
+        errno = EFAULT;
+        return RTX_ERR;
+    }
+
+    k_mpool_used(mpid, -(int)blk->size);
+    free_insert(p_pool, blk);
+
+    return RTX_OK;
+}
+
+/*
+ * shrinks by freeing the tail, grows into a free extent right above, ENOMEM if there is none
+ */
+int k_spool_resize(mpool_t mpid, void *ptr, size_t size, U32 *p_old)
+{
+    SPOOL *p_pool = get_spool(mpid);
+    SBLOCK *blk = alloc_block(p_pool, ptr);
+
+    if (blk == NULL) {
+        errno = EFAULT;
+        return RTX_ERR;
+    }
+    *p_old = blk->size - sizeof(SBLOCK);
+    if (size > p_pool->limit - p_pool->base) {
+        errno = ENOMEM;
+        return RTX_ERR;
+    }
+    U32 need = extent_size(size);
+
+    if (need > blk->size) {
+        U32 top = (U32)blk + blk->size;
+        SBLOCK **p_link = &p_pool->free_head;
+
+        while (*p_link != NULL && (U32)*p_link < top) {
+            p_link = &(*p_link)->next;
+        }
+
+        SBLOCK *above = *p_link;
+        if (above == NULL || (U32)above != top || blk->size + above->size < need) {
+            errno = ENOMEM;
+            return RTX_ERR;
+        }
+
+        // the rest of the extent above moves up, read it before its header is overwritten
+        U32 rest = blk->size + above->size - need;
+        SBLOCK *next = above->next;
+        if (rest >= MIN_EXTENT) {
+            SBLOCK *moved = (SBLOCK *)((U32)blk + need);
+            moved->size = rest;
+            moved->next = next;
+            *p_link = moved;
+        } else {
+            *p_link = next;
+            need += rest;
+        }
+        k_mpool_used(mpid, need - blk->size);
+        blk->size = need;
+    } else if (blk->size - need >= MIN_EXTENT) {
+        SBLOCK *tail = (SBLOCK *)((U32)blk + need);
+
+        tail->size = blk->size - need;
+        blk->size  = need;
+        k_mpool_used(mpid, -(int)tail->size);
+        free_insert(p_pool, tail);
+    }
+
+    return RTX_OK;
+}
+
+int k_spool_dump(mpool_t mpid)
+{
+    SPOOL *p_pool = get_spool(mpid);
+    int block_count = 0;
+
+    for (SBLOCK *ext = p_pool->free_head; ext != NULL; ext = ext->next) {
+        block_count++;
+        printf("0x%x: 0x%x\n\r", ext, ext->size);
+    }
+    printf("%d free memory block(s) found\n\r", block_count);
+    return block_count;
+}
+
+void k_spool_stats(mpool_t mpid, MEM_STATS *out)
+{
+    SPOOL *p_pool = get_spool(mpid);
+
+    for (SBLOCK *ext = p_pool->free_head; ext != NULL; ext = ext->next) {
+        k_mpool_free_blocks(out, ext->size, 1);
+    }
+}
+
+/*
+ * returns TRUE if [start, end] lies inside the payload of one allocated extent
+ */
+BOOL k_spool_is_reserved(mpool_t mpid, U32 start, U32 end)
+{
+    SPOOL *p_pool = get_spool(mpid);
+
+    // extents tile the pool, so each header leads to the next
+    for (U32 addr = p_pool->base; addr < p_pool->limit; addr += ((SBLOCK *)addr)->size) {
+        SBLOCK *blk = (SBLOCK *)addr;
+        if (start < addr + blk->size) {
+            return blk->next == (SBLOCK *)SPOOL_MAGIC && start >= (U32)(blk + 1) &&
+                   end < addr + blk->size;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ *===========================================================================
+ *                             END OF FILE
+ *===========================================================================
+ */
@@ -0,0 +1,79 @@
+/*
+ ****************************************************************************
+ *
+ *                  UNIVERSITY OF WATERLOO ECE 350 RTOS LAB
+ *
+ *                     Copyright 2020-2022 Yiqing Huang
+ *
+ *          This software is subject to an open source license and
+ *          may be freely redistributed under the terms of MIT License.
+ ****************************************************************************
+ */
+
+/**************************************************************************//**
+ * @file        k_mem_stack.h
+ * @brief       Stack Region (STACK_POOL) Memory Pool Header File
+ *
+ * @note        Created through k_mpool_create(STACK_POOL, ...), which takes a
+ *              descriptor slot and checks the range; k_mem_init makes one of
+ *              STACK_POOL_SIZE bytes for task stacks.
+ *
+ *****************************************************************************/
+
+#ifndef K_MEM_STACK_H_
+#define K_MEM_STACK_H_
+#include "k_inc.h"
+#include "mem_stats.h"
+
+/*
+ *===========================================================================
+ *                             MACROS
+ *===========================================================================
+ */
+
+#define SPOOL_ALIGN         8               /* extent size and payload alignment */
+#define SPOOL_MAGIC         0x5354434B      /* "STCK", link word of an allocated extent */
+
+/*
+ *===========================================================================
+ *                             STRUCTURES
+ *===========================================================================
+ */
+
+/**
+ * @brief   header of every extent, free or allocated; the payload follows it
+ */
+typedef struct sblock {
+    U32                 size;           /**< bytes of the extent including this header   */
+    struct sblock       *next;          /**< next free extent up, SPOOL_MAGIC if allocated */
+} SBLOCK;
+
+typedef struct spool {
+    U32         start;          /**< first byte of the range the pool was made over */
+    U32         end;            /**< last byte of the range the pool was made over  */
+    U32         base;           /**< first extent                                   */
+    U32         limit;          /**< one past the last extent                       */
+    SBLOCK      *free_head;     /**< free extents in address order                  */
+} SPOOL;
+
+/*
+ * ------------------------------------------------------------------------
+ *                             FUNCTION PROTOTYPES
+ * ------------------------------------------------------------------------
+ */
+
+int     k_spool_create  (SPOOL *p_pool, U32 start, U32 end);
+void   *k_spool_alloc   (mpool_t mpid, size_t size);
+int     k_spool_dealloc (mpool_t mpid, void *ptr);
+int     k_spool_resize  (mpool_t mpid, void *ptr, size_t size, U32 *p_old);
+int     k_spool_dump    (mpool_t mpid);
+void    k_spool_stats   (mpool_t mpid, MEM_STATS *out);
+BOOL    k_spool_is_reserved(mpool_t mpid, U32 start, U32 end);
+
+#endif // ! K_MEM_STACK_H_
+
+/*
+ *===========================================================================
+ *                             END OF FILE
+ *===========================================================================
+ */
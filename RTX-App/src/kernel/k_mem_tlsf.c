@@ -0,0 +1,402 @@
+/*
+ ****************************************************************************
+ *
+ *                  UNIVERSITY OF WATERLOO ECE 350 RTOS LAB
+ *
+ *                     Copyright 2020-2022 Yiqing Huang
+ *
+ *          This software is subject to an open source license and
+ *          may be freely redistributed under the terms of MIT License.
+ ****************************************************************************
+ */
+
+/**************************************************************************//**
+ * @file        k_mem_tlsf.c
+ * @brief       Two-Level Segregated Fit (TLSF) Memory Pool C Code
+ *
+ * @details     Free blocks are kept on segregated lists indexed by a first
+ *              level (power of two size class) and a second level (16 linear
+ *              sub-classes). Two levels of bitmaps plus CLZ find a list whose
+ *              blocks are all large enough, so alloc and free are O(1).
+ *              Requests are rounded to 8 bytes only; the remainder of a block
+ *              is split off and physically adjacent free blocks are merged
+ *              on free.
+ *
+ *              Layout of a pool:
+ *
+ *                 start-->+---------------------------+
+ *                         | hdr | payload             |  first
+ *                         |---------------------------|
+ *                         | hdr | payload             |
+ *                         |---------------------------|
+ *                         |  ...                      |
+ *                         |---------------------------|
+ *                         | hdr (size 0, used)        |  sentinel
+ *                   end-->+---------------------------+
+ *
+ *****************************************************************************/
+
+#include "k_inc.h"
+#include "k_mem.h"
+#include "k_mem_tlsf.h"
+#include "math.h"
+
+#define BLOCK_HDR_SIZE      ((U32)&((TLSF_BLOCK *)0)->next_free)  /* bytes before the payload */
+#define BLOCK_MIN_SIZE      (sizeof(TLSF_BLOCK) - BLOCK_HDR_SIZE)   /* smallest payload         */
+#define BLOCK_FREE          0x1U
+#define BLOCK_SIZE_MASK     (~(TLSF_ALIGN - 1))
+
+/*
+ *===========================================================================
+ *                            FUNCTIONS
+ *===========================================================================
+ */
+
+static U32 fls(U32 x)
+{
+    return 31 - clz(x);
+}
+
+static U32 ffs(U32 x)
+{
+    return 31 - clz(x & (~x + 1));
+}
+
+static U32 block_size(TLSF_BLOCK *block)
+{
+    return block->size & BLOCK_SIZE_MASK;
+}
+
+static BOOL block_is_free(TLSF_BLOCK *block)
+{
+    return block->size & BLOCK_FREE;
+}
+
+static void *block_payload(TLSF_BLOCK *block)
+{
+    return (U8 *)block + BLOCK_HDR_SIZE;
+}
+
+static TLSF_BLOCK *block_from_payload(void *ptr)
+{
+    return (TLSF_BLOCK *)((U8 *)ptr - BLOCK_HDR_SIZE);
+}
+
+static TLSF_BLOCK *block_next(TLSF_BLOCK *block)
+{
+    return (TLSF_BLOCK *)((U8 *)block_payload(block) + block_size(block));
+}
+
+/* size class of a block of the given size */
+static void mapping_insert(U32 size, U32 *p_fl, U32 *p_sl)
+{
+    if (size < TLSF_SMALL_BLOCK) {
+        *p_fl = 0;
+        *p_sl = size >> TLSF_ALIGN_LOG2;
+    } else {
+        U32 fl = fls(size);
+        *p_sl = (size >> (fl - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+        *p_fl = fl - (TLSF_FL_SHIFT - 1);
+    }
+}
+
+/* smallest size class whose blocks are all at least size bytes */
+static void mapping_search(U32 size, U32 *p_fl, U32 *p_sl)
+{
+    if (size >= TLSF_SMALL_BLOCK) {
+        size += (1U << (fls(size) - TLSF_SL_LOG2)) - 1;
+    }
+    mapping_insert(size, p_fl, p_sl);
+}
+
+static void insert_free_block(TLSF_POOL *p_pool, TLSF_BLOCK *block)
+{
+    U32 fl, sl;
+    mapping_insert(block_size(block), &fl, &sl);
+    
+    TLSF_BLOCK *head = p_pool->blocks[fl][sl];
+    block->next_free = head;
+    block->prev_free = NULL;
+    if (head != NULL) {
+        head->prev_free = block;
+    }
+    p_pool->blocks[fl][sl] = block;
+    p_pool->fl_bitmap |= BIT(fl);
+    p_pool->sl_bitmap[fl] |= BIT(sl);
+}
+
+static void remove_free_block(TLSF_POOL *p_pool, TLSF_BLOCK *block)
+{
+    U32 fl, sl;
+    mapping_insert(block_size(block), &fl, &sl);
+    
+    if (block->prev_free != NULL) {
+        block->prev_free->next_free = block->next_free;
+    } else {
+        p_pool->blocks[fl][sl] = block->next_free;
+    }
+    if (block->next_free != NULL) {
+        block->next_free->prev_free = block->prev_free;
+    }
+    
+    if (p_pool->blocks[fl][sl] == NULL) {
+        p_pool->sl_bitmap[fl] &= ~BIT(sl);
+        if (p_pool->sl_bitmap[fl] == 0) {
+            p_pool->fl_bitmap &= ~BIT(fl);
+        }
+    }
+}
+
+/* first block on the lowest non-empty list at or above (fl, sl), NULL if none */
+static TLSF_BLOCK *find_suitable_block(TLSF_POOL *p_pool, U32 fl, U32 sl)
+{
+    if (fl >= TLSF_FL_COUNT) {
+        return NULL;
+    }
+    
+    U32 sl_map = p_pool->sl_bitmap[fl] & (~0U << sl);
+    if (sl_map == 0) {
+        U32 fl_map = (fl + 1 < TLSF_FL_COUNT) ? p_pool->fl_bitmap & (~0U << (fl + 1)) : 0;
+        if (fl_map == 0) {
+            return NULL;
+        }
+        fl = ffs(fl_map);
+        sl_map = p_pool->sl_bitmap[fl];
+    }
+    
+    return p_pool->blocks[fl][ffs(sl_map)];
+}
+
+/* round a request up to a valid payload size */
+static U32 adjust_size(size_t size)
+{
+    U32 adjust = (size + TLSF_ALIGN - 1) & BLOCK_SIZE_MASK;
+    return (adjust < BLOCK_MIN_SIZE) ? BLOCK_MIN_SIZE : adjust;
+}
+
+/* TRUE if ptr is the payload of a used block inside the pool, which rules out double frees */
+static BOOL block_is_used(TLSF_POOL *p_pool, void *ptr)
+{
+    TLSF_BLOCK *block = block_from_payload(ptr);
+    
+    return !((U32)ptr & (TLSF_ALIGN - 1) ||
+             block < p_pool->first || block >= p_pool->sentinel || block_is_free(block) ||
+             block_next(block) > p_pool->sentinel || block_next(block)->prev_phys != block);
+}
+
+/* split off the tail of a used block if it can hold a block of its own, merging it with a free next block */
+static void block_trim(TLSF_POOL *p_pool, TLSF_BLOCK *block, U32 adjust)
+{
+    U32 remain = block_size(block) - adjust;
+    
+    if (remain < BLOCK_HDR_SIZE + BLOCK_MIN_SIZE) {
+        return;
+    }
+    block->size = adjust;
+    
+    TLSF_BLOCK *rest = block_next(block);
+    TLSF_BLOCK *next = (TLSF_BLOCK *)((U8 *)rest + remain);
+    rest->prev_phys = block;
+    rest->size = remain - BLOCK_HDR_SIZE;
+    if (block_is_free(next)) {
+        remove_free_block(p_pool, next);
+        rest->size += BLOCK_HDR_SIZE + block_size(next);
+        next = block_next(rest);
+    }
+    rest->size |= BLOCK_FREE;
+    next->prev_phys = rest;
+    insert_free_block(p_pool, rest);
+}
+
+int k_tlsf_create(TLSF_POOL *p_pool, U32 start, U32 end)
+{
+    U32 base  = (start + TLSF_ALIGN - 1) & BLOCK_SIZE_MASK;
+    U32 limit = (end + 1) & BLOCK_SIZE_MASK;
+    
+    if (base + 2 * BLOCK_HDR_SIZE + BLOCK_MIN_SIZE > limit) {
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+    
+    p_pool->fl_bitmap = 0;
+    for (int fl = 0; fl < TLSF_FL_COUNT; fl++) {
+        p_pool->sl_bitmap[fl] = 0;
+        for (int sl = 0; sl < TLSF_SL_COUNT; sl++) {
+            p_pool->blocks[fl][sl] = NULL;
+        }
+    }
+    
+    // one free block spanning the pool, closed by a used zero-sized sentinel
+    TLSF_BLOCK *block = (TLSF_BLOCK *)base;
+    block->prev_phys = NULL;
+    block->size = (limit - base - 2 * BLOCK_HDR_SIZE) | BLOCK_FREE;
+    
+    TLSF_BLOCK *sentinel = block_next(block);
+    sentinel->prev_phys = block;
+    sentinel->size = 0;
+    
+    p_pool->first = block;
+    p_pool->sentinel = sentinel;
+    insert_free_block(p_pool, block);
+    
+    return RTX_OK;
+}
+
+void *k_tlsf_alloc(mpool_t mpid, size_t size)
+{
+    TLSF_POOL *p_pool = (TLSF_POOL *)g_mpools[mpid].ctrl;
+    
+    if (size == 0) {
+        return NULL;
+    }
+    if (size > (U32)p_pool->sentinel - (U32)p_pool->first) {
+        // too large for any pool, and keeps the rounding below from overflowing
+        errno = ENOMEM;
+        return NULL;
+    }
+    
+    U32 adjust = adjust_size(size);
+    U32 fl, sl;
+    mapping_search(adjust, &fl, &sl);
+    TLSF_BLOCK *block = find_suitable_block(p_pool, fl, sl);
+    if (block == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    remove_free_block(p_pool, block);
+    block->size &= ~BLOCK_FREE;
+    block_trim(p_pool, block, adjust);
+    
+    k_mpool_used(mpid, BLOCK_HDR_SIZE + block_size(block));
+    return block_payload(block);
+}
+
+int k_tlsf_dealloc(mpool_t mpid, void *ptr)
+{
+    TLSF_POOL *p_pool = (TLSF_POOL *)g_mpools[mpid].ctrl;
+    TLSF_BLOCK *block = block_from_payload(ptr);
+    
+    if (!block_is_used(p_pool, ptr)) {
+        errno = EFAULT;
+        return RTX_ERR;
+    }
+    
+    // flag the header first so a stale pointer to a merged block still reads as free
+    block->size |= BLOCK_FREE;
+    k_mpool_used(mpid, -(int)(BLOCK_HDR_SIZE + block_size(block)));
+    
+    TLSF_BLOCK *prev = block->prev_phys;
+    if (prev != NULL && block_is_free(prev)) {
+        remove_free_block(p_pool, prev);
+        prev->size = block_size(prev) + BLOCK_HDR_SIZE + block_size(block);
+        block = prev;
+    }
+    
+    TLSF_BLOCK *next = block_next(block);
+    if (block_is_free(next)) {
+        remove_free_block(p_pool, next);
+        block->size = block_size(block) + BLOCK_HDR_SIZE + block_size(next);
+        next = block_next(block);
+    }
+    
+    block->size |= BLOCK_FREE;
+    next->prev_phys = block;
+    insert_free_block(p_pool, block);
+    
+    return RTX_OK;
+}
+
+/*
+ * Resizes a used block without moving it: shrinking splits off the tail,
+ * growing absorbs the physically next block if it is free and large enough.
+ * Fails with ENOMEM otherwise, p_old is set to the current payload size.
+ */
+int k_tlsf_resize(mpool_t mpid, void *ptr, size_t size, U32 *p_old)
+{
+    TLSF_POOL *p_pool = (TLSF_POOL *)g_mpools[mpid].ctrl;
+    TLSF_BLOCK *block = block_from_payload(ptr);
+    
+    if (!block_is_used(p_pool, ptr)) {
+        errno = EFAULT;
+        return RTX_ERR;
+    }
+    
+    U32 old_size = block_size(block);
+    *p_old = old_size;
+    if (size > (U32)p_pool->sentinel - (U32)p_pool->first) {
+        errno = ENOMEM;
+        return RTX_ERR;
+    }
+    
+    U32 adjust = adjust_size(size);
+    if (adjust > old_size) {
+        TLSF_BLOCK *next = block_next(block);
+        if (!block_is_free(next) || old_size + BLOCK_HDR_SIZE + block_size(next) < adjust) {
+            errno = ENOMEM;
+            return RTX_ERR;
+        }
+        remove_free_block(p_pool, next);
+        block->size = old_size + BLOCK_HDR_SIZE + block_size(next);
+        block_next(block)->prev_phys = block;
+    }
+    block_trim(p_pool, block, adjust);
+    
+    k_mpool_used(mpid, (int)block_size(block) - (int)old_size);
+    return RTX_OK;
+}
+
+/* payload size of the used block at ptr, 0 if ptr is not one */
+U32 k_tlsf_size(mpool_t mpid, void *ptr)
+{
+    TLSF_POOL *p_pool = (TLSF_POOL *)g_mpools[mpid].ctrl;
+    
+    return block_is_used(p_pool, ptr) ? block_size(block_from_payload(ptr)) : 0;
+}
+
+int k_tlsf_dump(mpool_t mpid)
+{
+    TLSF_POOL *p_pool = (TLSF_POOL *)g_mpools[mpid].ctrl;
+    int block_count = 0;
+    
+    for (TLSF_BLOCK *block = p_pool->first; block != p_pool->sentinel; block = block_next(block)) {
+        if (block_is_free(block)) {
+            block_count++;
+            printf("0x%x: 0x%x\n\r", block_payload(block), block_size(block));
+        }
+    }
+    printf("%d free memory block(s) found\n\r", block_count);
+    return block_count;
+}
+
+void k_tlsf_stats(mpool_t mpid, MEM_STATS *out)
+{
+    TLSF_POOL *p_pool = (TLSF_POOL *)g_mpools[mpid].ctrl;
+    
+    for (TLSF_BLOCK *block = p_pool->first; block != p_pool->sentinel; block = block_next(block)) {
+        if (block_is_free(block)) {
+            k_mpool_free_blocks(out, block_size(block), 1);
+        }
+    }
+}
+
+/*
+ * returns TRUE if [start, end] lies inside the payload of one used block
+ */
+BOOL k_tlsf_is_reserved(mpool_t mpid, U32 start, U32 end)
+{
+    TLSF_POOL *p_pool = (TLSF_POOL *)g_mpools[mpid].ctrl;
+    
+    for (TLSF_BLOCK *block = p_pool->first; block != p_pool->sentinel; block = block_next(block)) {
+        U32 payload = (U32)block_payload(block);
+        if (start < payload + block_size(block)) {
+            return !block_is_free(block) && start >= payload && end < payload + block_size(block);
+        }
+    }
+    return FALSE;
+}
+
+/*
+ *===========================================================================
+ *                             END OF FILE
+ *===========================================================================
+ */
@@ -0,0 +1,88 @@
+/*
+ ****************************************************************************
+ *
+ *                  UNIVERSITY OF WATERLOO ECE 350 RTOS LAB
+ *
+ *                     Copyright 2020-2022 Yiqing Huang
+ *
+ *          This software is subject to an open source license and
+ *          may be freely redistributed under the terms of MIT License.
+ ****************************************************************************
+ */
+
+/**************************************************************************//**
+ * @file        k_mem_tlsf.h
+ * @brief       Two-Level Segregated Fit (TLSF) Memory Pool Header File
+ *
+ * @note        Selected for both IRAM pools with RTX_SYS_INFO.mem_algo = TLSF,
+ *              or for a single pool with k_mpool_create(TLSF, ...).
+ *
+ *****************************************************************************/
+
+#ifndef K_MEM_TLSF_H_
+#define K_MEM_TLSF_H_
+#include "k_inc.h"
+#include "mem_stats.h"
+
+/*
+ *===========================================================================
+ *                             MACROS
+ *===========================================================================
+ */
+
+#define TLSF_ALIGN_LOG2     3                               /* 8-byte granularity              */
+#define TLSF_ALIGN          (1U << TLSF_ALIGN_LOG2)
+#define TLSF_SL_LOG2        4                               /* 16 second-level lists per class */
+#define TLSF_SL_COUNT       (1U << TLSF_SL_LOG2)
+#define TLSF_FL_SHIFT       (TLSF_SL_LOG2 + TLSF_ALIGN_LOG2)
+#define TLSF_SMALL_BLOCK    (1U << TLSF_FL_SHIFT)           /* sizes below this map linearly   */
+#define TLSF_FL_COUNT       (MEM2_POWER - TLSF_FL_SHIFT + 2)/* enough classes for the largest pool */
+
+/*
+ *===========================================================================
+ *                             STRUCTURES
+ *===========================================================================
+ */
+
+/**
+ * @brief   block header, the payload starts right after the size field
+ * @note    next_free/prev_free are only valid while the block is free and
+ *          live in the first bytes of the payload
+ */
+typedef struct tlsf_block {
+    struct tlsf_block   *prev_phys;     /**< physically previous block, NULL for the first */
+    U32                 size;           /**< payload size in bytes, bit 0 set while free   */
+    struct tlsf_block   *next_free;     /**< next block on the same free list              */
+    struct tlsf_block   *prev_free;     /**< previous block on the same free list          */
+} TLSF_BLOCK;
+
+typedef struct tlsf_pool {
+    U32         fl_bitmap;                                  /**< bit f set iff some blocks[f][*] is non-empty */
+    U32         sl_bitmap[TLSF_FL_COUNT];                   /**< bit s set iff blocks[f][s] is non-empty      */
+    TLSF_BLOCK  *blocks[TLSF_FL_COUNT][TLSF_SL_COUNT];      /**< free list heads                              */
+    TLSF_BLOCK  *first;                                     /**< first physical block                         */
+    TLSF_BLOCK  *sentinel;                                  /**< zero-sized used block closing the pool       */
+} TLSF_POOL;
+
+/*
+ * ------------------------------------------------------------------------
+ *                             FUNCTION PROTOTYPES
+ * ------------------------------------------------------------------------
+ */
+
+int     k_tlsf_create       (TLSF_POOL *p_pool, U32 start, U32 end);
+void   *k_tlsf_alloc        (mpool_t mpid, size_t size);
+int     k_tlsf_dealloc      (mpool_t mpid, void *ptr);
+int     k_tlsf_resize       (mpool_t mpid, void *ptr, size_t size, U32 *p_old);
+U32     k_tlsf_size         (mpool_t mpid, void *ptr);
+int     k_tlsf_dump         (mpool_t mpid);
+void    k_tlsf_stats        (mpool_t mpid, MEM_STATS *out);
+BOOL    k_tlsf_is_reserved  (mpool_t mpid, U32 start, U32 end);
+
+#endif // ! K_MEM_TLSF_H_
+
+/*
+ *===========================================================================
+ *                             END OF FILE
+ *===========================================================================
+ */
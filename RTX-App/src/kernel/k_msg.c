@@ -43,7 +43,7 @@ void rt_waitlist_add(DLIST *wait_list, TCB *p_tcb)
 {
 	TCB *traverse = (TCB *)wait_list->head;
 	while (traverse != NULL) {		
-		if (p_tcb->timeout < traverse->timeout) {
+		if (rt_before(p_tcb, traverse)) {
 			insert_before(wait_list, (DNODE *)p_tcb, (DNODE *)traverse);
 			break;
 		}			
@@ -54,6 +54,44 @@ void rt_waitlist_add(DLIST *wait_list, TCB *p_tcb)
 	}	
 }
 
+/*
+ * adds a blocked sender behind every waiting task of the same or higher priority
+ */
+void waitlist_add(DLIST *wait_list, TCB *p_tcb)
+{
+	TCB *traverse = (TCB *)wait_list->head;
+	while (traverse != NULL && traverse->prio <= p_tcb->prio) {
+		traverse = traverse->next;
+	}
+	if (traverse == NULL) {
+		push_back(wait_list, (DNODE *)p_tcb);
+	}
+	else {
+		insert_before(wait_list, (DNODE *)p_tcb, (DNODE *)traverse);
+	}
+}
+
+#if SHARED_K_STACK
+/*
+ * Continuations of the blocking calls. A task that blocks on the shared kernel
+ * stack cannot keep its place inside the call, so the call is run again on the
+ * stacked arguments once the task is switched back in.
+ */
+static int send_msg_cont(U32 *args)
+{
+	// the receiver copied the message out of queued_msg while we were blocked
+	if (TCB_OF(args[0]).mb.buf_start != NULL && gp_current_task->queued_msg == NULL) {
+		return 0;
+	}
+	return k_send_msg((task_t) args[0], (const void *) args[1]);
+}
+
+static int recv_msg_cont(U32 *args)
+{
+	return k_recv_msg((void *) args[0], (size_t) args[1]);
+}
+#endif
+
 int k_mbx_create(size_t size) {
 #ifdef DEBUG_0
     printf("k_mbx_create: size = %u\r\n", size);
@@ -70,7 +108,7 @@ int k_mbx_create(size_t size) {
 		}
 
 		mb->space = size;
-		mb->buf_start = k_mpool_alloc(MPID_IRAM2, size);
+		mb->buf_start = k_alloc_mbx(gp_current_task->tid, size);
 		
 		if (mb->buf_start == NULL) {
 			return RTX_ERR;
@@ -81,10 +119,7 @@ int k_mbx_create(size_t size) {
 		mb->buf_end = mb->buf_start + size;
 
 		//Clears garbage bits.
-		mb->wait_list[0].head = NULL;
-    mb->wait_list[1].head = NULL;
-    mb->wait_list[2].head = NULL;
-    mb->wait_list[3].head = NULL;
+		mb->wait_list.head = NULL;
 		mb->rt_wait_list.head = NULL;
 
     return gp_current_task->tid;
@@ -102,12 +137,12 @@ int k_send_msg(task_t receiver_tid, const void *buf) {
 	}
 	
 	int length = *(int *)(data);
-	if (receiver_tid > MAX_TASKS || length < MIN_MSG_SIZE) {
+	if (receiver_tid >= MAX_TASKS || length < MIN_MSG_SIZE) {
 		errno = EINVAL;
 		return RTX_ERR;
 	}
 	
-  TCB *rec_tcb = &g_tcbs[receiver_tid];
+  TCB *rec_tcb = &TCB_OF(receiver_tid);
 	if (rec_tcb->mb.buf_start == NULL) {
 		errno = ENOENT;
 		return RTX_ERR;
@@ -123,17 +158,22 @@ int k_send_msg(task_t receiver_tid, const void *buf) {
     p_tcb->queued_msg = data;
 		p_tcb->blocked_on = rec_tcb;
 		if (p_tcb->prio == PRIO_RT) {
-			pop_front(&rt_queue);
+			rt_queue_remove(p_tcb);
 			rt_waitlist_add(&rec_tcb->mb.rt_wait_list, p_tcb);
 		}
 		else {
-			pop_front(&prio_queue[p_tcb->prio - PRIO_OFFSET]);
-			push_back(&rec_tcb->mb.wait_list[p_tcb->prio - PRIO_OFFSET], (DNODE *)p_tcb);
+			ready_remove(p_tcb);
+			waitlist_add(&rec_tcb->mb.wait_list, p_tcb);
 		}
+#if SHARED_K_STACK
+		p_tcb->cont = send_msg_cont;
+		k_tsk_run_new(INVOLUNTARY);
+		return 0;
+#else
     k_tsk_run_new(INVOLUNTARY);
 		
 		// Check if mailbox still exists
-		if (g_tcbs[receiver_tid].mb.buf_start == NULL) {
+		if (TCB_OF(receiver_tid).mb.buf_start == NULL) {
 			errno = ENOENT;
 			return RTX_ERR;
 		}
@@ -143,6 +183,7 @@ int k_send_msg(task_t receiver_tid, const void *buf) {
 			length = 0;
 			break;
 		}
+#endif
   }
 
   for (int i = 0; i < length; ++i) {
@@ -155,7 +196,7 @@ int k_send_msg(task_t receiver_tid, const void *buf) {
 			rt_queue_add(rec_tcb);
 		}
 		else {
-			push_back(&prio_queue[rec_tcb->prio - PRIO_OFFSET], (DNODE *)rec_tcb);
+			ready_push(rec_tcb);
 		}
 		
     k_tsk_run_new(INVOLUNTARY);
@@ -176,12 +217,12 @@ int k_send_msg_nb(task_t receiver_tid, const void *buf) {
 	}
 	
 	int length = *(int *)(data);
-	if (receiver_tid > MAX_TASKS || length < MIN_MSG_SIZE) {
+	if (receiver_tid >= MAX_TASKS || length < MIN_MSG_SIZE) {
 		errno = EINVAL;
 		return RTX_ERR;
 	}
 		
-  TCB *rec_tcb = &g_tcbs[receiver_tid];
+  TCB *rec_tcb = &TCB_OF(receiver_tid);
 	if (rec_tcb->mb.buf_start == NULL) {
 		errno = ENOENT;
 		return RTX_ERR;
@@ -205,7 +246,7 @@ int k_send_msg_nb(task_t receiver_tid, const void *buf) {
 			rt_queue_add(rec_tcb);
 		}
 		else {
-			push_back(&prio_queue[rec_tcb->prio - PRIO_OFFSET], (DNODE *)rec_tcb);
+			ready_push(rec_tcb);
 		}
 		
 		if ( data[5] != KEY_IN ) {
@@ -235,8 +276,19 @@ int k_recv_msg(void *buf, size_t len) {
 
 	while (mb_empty(&p_tcb->mb)) {
 		p_tcb->state = BLK_RECV;
-		pop_front(&prio_queue[p_tcb->prio - PRIO_OFFSET]);
+		if (p_tcb->prio == PRIO_RT) {
+			rt_queue_remove(p_tcb);
+		}
+		else {
+			ready_remove(p_tcb);
+		}
+#if SHARED_K_STACK
+		p_tcb->cont = recv_msg_cont;
+		k_tsk_run_new(INVOLUNTARY);
+		return 0;
+#else
 		k_tsk_run_new(INVOLUNTARY);
+#endif
 	}
 	
 	int msg_length = msg_len(&p_tcb->mb);
@@ -253,6 +305,7 @@ int k_recv_msg(void *buf, size_t len) {
 	TCB *traverse = (TCB *)p_tcb->mb.rt_wait_list.head;
 	while (traverse != NULL) {
 
+		TCB *next = traverse->next;
 		if (p_tcb->mb.space >= *(int *)(traverse->queued_msg)) {
 			for (int i = 0; i < *(int *)(traverse->queued_msg); ++i) {
 				enqueue(&p_tcb->mb, traverse->queued_msg[i]);
@@ -262,23 +315,22 @@ int k_recv_msg(void *buf, size_t len) {
 			remove(&p_tcb->mb.rt_wait_list, (DNODE *)traverse);
 			rt_queue_add(traverse);
 		}
-		traverse = traverse->next;
+		traverse = next;
 	}
-	for (int prio = 0; prio < 4; ++prio) {
-			traverse = (TCB *)p_tcb->mb.wait_list[prio].head;
-			while (traverse != NULL) {
-
-				if (p_tcb->mb.space >= *(int *)(traverse->queued_msg)) {
-					for (int i = 0; i < *(int *)(traverse->queued_msg); ++i) {
-						enqueue(&p_tcb->mb, traverse->queued_msg[i]);
-					}
-					traverse->queued_msg = NULL;
-					traverse->state = READY;
-					remove(&p_tcb->mb.wait_list[prio], (DNODE *)traverse);
-					push_back(&prio_queue[traverse->prio - PRIO_OFFSET], (DNODE *)traverse);
-				}
-				traverse = traverse->next;
+	traverse = (TCB *)p_tcb->mb.wait_list.head;
+	while (traverse != NULL) {
+
+		TCB *next = traverse->next;
+		if (p_tcb->mb.space >= *(int *)(traverse->queued_msg)) {
+			for (int i = 0; i < *(int *)(traverse->queued_msg); ++i) {
+				enqueue(&p_tcb->mb, traverse->queued_msg[i]);
 			}
+			traverse->queued_msg = NULL;
+			traverse->state = READY;
+			remove(&p_tcb->mb.wait_list, (DNODE *)traverse);
+			ready_push(traverse);
+		}
+		traverse = next;
 	}
 
   k_tsk_run_new(INVOLUNTARY);
@@ -322,6 +374,7 @@ int k_recv_msg_nb(void *buf, size_t len) {
 	TCB *traverse = (TCB *)p_tcb->mb.rt_wait_list.head;
 	while (traverse != NULL) {
 
+		TCB *next = traverse->next;
 		if (p_tcb->mb.space >= *(int *)(traverse->queued_msg)) {
 			for (int i = 0; i < *(int *)(traverse->queued_msg); ++i) {
 				enqueue(&p_tcb->mb, traverse->queued_msg[i]);
@@ -331,23 +384,22 @@ int k_recv_msg_nb(void *buf, size_t len) {
 			remove(&p_tcb->mb.rt_wait_list, (DNODE *)traverse);
 			rt_queue_add(traverse);
 		}
-		traverse = traverse->next;
+		traverse = next;
 	}
-	for (int prio = 0; prio < 4; ++prio) {
-			traverse = (TCB *)p_tcb->mb.wait_list[prio].head;
-			while (traverse != NULL) {
-
-				if (p_tcb->mb.space >= *(int *)(traverse->queued_msg)) {
-					for (int i = 0; i < *(int *)(traverse->queued_msg); ++i) {
-						enqueue(&p_tcb->mb, traverse->queued_msg[i]);
-					}
-					traverse->queued_msg = NULL;
-					traverse->state = READY;
-					remove(&p_tcb->mb.wait_list[prio], (DNODE *)traverse);
-					push_back(&prio_queue[traverse->prio - PRIO_OFFSET], (DNODE *)traverse);
-				}
-				traverse = traverse->next;
+	traverse = (TCB *)p_tcb->mb.wait_list.head;
+	while (traverse != NULL) {
+
+		TCB *next = traverse->next;
+		if (p_tcb->mb.space >= *(int *)(traverse->queued_msg)) {
+			for (int i = 0; i < *(int *)(traverse->queued_msg); ++i) {
+				enqueue(&p_tcb->mb, traverse->queued_msg[i]);
 			}
+			traverse->queued_msg = NULL;
+			traverse->state = READY;
+			remove(&p_tcb->mb.wait_list, (DNODE *)traverse);
+			ready_push(traverse);
+		}
+		traverse = next;
 	}
 
   k_tsk_run_new(INVOLUNTARY);
@@ -366,9 +418,9 @@ int k_mbx_ls(task_t *buf, size_t count) {
     }
 
     int tasks = 0;
-    for (int i = 0; i < MAX_TASKS && tasks <= count; ++i) {
-       if (g_tcbs[i].mb.buf_start != NULL) {
-           buf[tasks] = g_tcbs[i].tid;
+    for (int i = k_tsk_next(0); i < MAX_TASKS && tasks < count; i = k_tsk_next(i + 1)) {
+       if (TCB_OF(i).mb.buf_start != NULL) {
+           buf[tasks] = TCB_OF(i).tid;
            ++tasks;
        }
     }
@@ -381,12 +433,16 @@ int k_mbx_get(task_t tid)
 #ifdef DEBUG_0
     printf("k_mbx_get: tid=%u\r\n", tid);
 #endif /* DEBUG_0 */
-		if (g_tcbs[tid].mb.buf_start == NULL) {
+		if (tid >= MAX_TASKS) {
+			errno = EINVAL;
+			return RTX_ERR;
+		}
+		if (TCB_OF(tid).mb.buf_start == NULL) {
 			errno = ENOENT;
 			return RTX_ERR;
 		}
 	
-    return g_tcbs[tid].mb.space;
+    return TCB_OF(tid).mb.space;
 }
 /*
  *===========================================================================
@@ -48,6 +48,7 @@ int k_recv_msg      (void *buf, size_t len);
 int k_recv_msg_nb   (void *buf, size_t len);
 int k_mbx_ls        (task_t *buf, size_t count);
 int k_mbx_get       (task_t tid);
+void waitlist_add   (DLIST *wait_list, TCB *p_tcb);
 
 #endif // ! K_MSG_H_
 
@@ -58,8 +58,8 @@ int k_pre_rtx_init (void *args)
         return RTX_ERR;
     }
     
-    g_tcbs[TID_NULL].u_sp_base = (U32)k_alloc_p_stack(TID_NULL, PROC_STACK_SIZE);
-    __set_PSP(g_tcbs[TID_NULL].u_sp_base);
+    TCB_OF(TID_NULL).u_sp_base = (U32)k_alloc_p_stack(TID_NULL, PROC_STACK_SIZE);
+    __set_PSP(TCB_OF(TID_NULL).u_sp_base);
     
     return RTX_OK;
 }
@@ -72,6 +72,12 @@ int k_rtx_init(RTX_SYS_INFO *sys_info, TASK_INIT *tasks, int num_tasks)
         errno = EINVAL;
         return RTX_ERR;
     }
+    if (sys_info->sched != DEFAULT && sys_info->sched != EDF &&
+        sys_info->sched != RM_PS && sys_info->sched != RM_NPS) {
+        errno = EINVAL;
+        return RTX_ERR;
+    }
+    g_sched = sys_info->sched;
     
     /* interrupts are already disabled when we enter here */
     if ( uart_irq_init(0) != RTX_OK ) {
@@ -51,6 +51,25 @@
 #include "k_inc.h"
 //#include "k_task.h"
 #include "k_rtx.h"
+#include "math.h"
+
+#if PRIO_LEVELS > 32
+#error "the ready bitmap is one word, PRIO_LEVELS must be at most 32"
+#endif
+#if MAX_TASKS > TID_TIMER
+#error "TIDs from TID_TIMER up are reserved, MAX_TASKS is too large"
+#endif
+#if !SHARED_K_STACK && MAX_TASKS * (KERN_STACK_SIZE + PROC_STACK_SIZE) > RAM2_SIZE
+#error "the minimum stacks of MAX_TASKS tasks do not fit in IRAM2, set SHARED_K_STACK"
+#endif
+#if TCB_ON_DEMAND && STATIC_ALLOC
+#error "TCB_ON_DEMAND allocates after boot, it cannot be used with STATIC_ALLOC"
+#endif
+#if PS_BUDGET == 0 || PS_BUDGET >= PS_PERIOD
+#error "the polling server needs 0 < PS_BUDGET < PS_PERIOD"
+#endif
+
+#define TID_WORDS   ((MAX_TASKS + 31) >> 5)
 
 /*
  *==========================================================================
@@ -59,15 +78,39 @@
  */
 
 TCB             *gp_current_task = NULL;    // the current RUNNING task
+#if TCB_ON_DEMAND
+TCB             g_tcb_null;                 // the null task's TCB, used before k_tsk_init
+TCB             g_tcb_dormant;              // stands in for every TID without a task
+TCB            *g_tcb_table[MAX_TASKS] = { &g_tcb_null };
+#else
 TCB             g_tcbs[MAX_TASKS];          // an array of TCBs
+#endif
 //TASK_INIT       g_null_task_info;           // The null task info
 U32             g_num_active_tasks = 0;     // number of non-dormant tasks
 
 // index goes from highest to lowest priority
-DLIST prio_queue[4];
+DLIST prio_queue[PRIO_LEVELS];
+
+// bit 31 - i set if prio_queue[i] is not empty, so clz gives the highest ready level
+U32 g_ready_map;
+
+// bit (tid & 31) of word tid >> 5 set if k_tsk_create may use tid
+U32 g_tid_free[TID_WORDS];
+
+// binary min-heap of ready RT tasks, g_rt_heap[0] runs first, see rt_before
+TCB *g_rt_heap[MAX_TASKS];
+U32 g_rt_count;
+U32 g_rt_seq;                   // insertion count, keeps equal keys first come first served
 
-// sorted from lowest to highest deadline
-DLIST rt_queue;
+// RTX_SYS_INFO.sched, picks the key of g_rt_heap
+int g_sched = DEFAULT;
+
+// RM_PS polling server. It is scheduled like a RT task of period PS_PERIOD
+// but never runs itself: while it is the heap root, the non-RT tasks run
+// in its place and use up its budget.
+static TCB  g_tcb_ps;
+static U32  g_ps_budget;            // ticks left in the current period
+static BOOL g_ps_serving;           // gp_current_task runs on the server's budget
 
 // sorted by relative timeouts
 DLIST timeout_list;
@@ -127,19 +170,89 @@ The memory map of the OS image may look like the following:
  *===========================================================================
  */
  
+/**
+ * @brief   TRUE if RT task a must run before b. EDF and DEFAULT order by
+ *          absolute deadline, RM_PS and RM_NPS by period first. Deadlines
+ *          are compared as a signed distance, so the order holds across a
+ *          wrap of g_timer_count as long as they are under 2^31 ticks apart.
+ */
+BOOL rt_before(TCB *a, TCB *b)
+{
+    if ((g_sched == RM_PS || g_sched == RM_NPS) && a->deadline != b->deadline) {
+        return a->deadline < b->deadline;
+    }
+    if (a->timeout != b->timeout) {
+        return (int)(a->timeout - b->timeout) < 0;
+    }
+    return (int)(a->rt_seq - b->rt_seq) < 0;
+}
+
+static void rt_heap_place(U32 slot, TCB *p_tcb)
+{
+    g_rt_heap[slot] = p_tcb;
+    p_tcb->rt_slot = slot;
+}
+
+/*
+ * moves p_tcb from a hole at slot towards the root until its parent comes first
+ */
+static void rt_sift_up(U32 slot, TCB *p_tcb)
+{
+    while (slot > 0) {
+        U32 parent = (slot - 1) >> 1;
+
+        if (!rt_before(p_tcb, g_rt_heap[parent])) {
+            break;
+        }
+        rt_heap_place(slot, g_rt_heap[parent]);
+        slot = parent;
+    }
+    rt_heap_place(slot, p_tcb);
+}
+
+/*
+ * moves p_tcb from a hole at slot towards the leaves until no child comes first
+ */
+static void rt_sift_down(U32 slot, TCB *p_tcb)
+{
+    for (U32 child = 2 * slot + 1; child < g_rt_count; child = 2 * slot + 1) {
+        if (child + 1 < g_rt_count && rt_before(g_rt_heap[child + 1], g_rt_heap[child])) {
+            child++;
+        }
+        if (!rt_before(g_rt_heap[child], p_tcb)) {
+            break;
+        }
+        rt_heap_place(slot, g_rt_heap[child]);
+        slot = child;
+    }
+    rt_heap_place(slot, p_tcb);
+}
+
+/**
+ * @brief   make a RT task ready, O(log n) in the number of ready RT tasks
+ */
 void rt_queue_add(TCB *p_tcb)
 {
-	TCB *traverse = (TCB *)rt_queue.head;
-	while (traverse != NULL) {		
-		if (p_tcb->timeout < traverse->timeout) {
-			insert_before(&rt_queue, (DNODE *)p_tcb, (DNODE *)traverse);
-			break;
-		}			
-		traverse = traverse->next;
-	}
-	if (traverse == NULL) {
-		push_back(&rt_queue, (DNODE *)p_tcb);
-	}	
+    p_tcb->rt_seq = g_rt_seq++;
+    rt_sift_up(g_rt_count++, p_tcb);
+}
+
+/**
+ * @brief   take a ready RT task out of the heap, the last one fills its slot
+ */
+void rt_queue_remove(TCB *p_tcb)
+{
+    U32 slot = p_tcb->rt_slot;
+    TCB *last = g_rt_heap[--g_rt_count];
+
+    if (last == p_tcb) {
+        return;
+    }
+    if (slot > 0 && rt_before(last, g_rt_heap[(slot - 1) >> 1])) {
+        rt_sift_up(slot, last);
+    } else {
+        rt_sift_down(slot, last);
+    }
 }
 
 void timeout_list_add(TCB *p_tcb)
@@ -160,6 +273,186 @@ void timeout_list_add(TCB *p_tcb)
 	}
 }
 
+/**
+ * @brief   make the polling server ready with a full budget, RM_PS only
+ */
+static void ps_init(void)
+{
+    g_tcb_ps.prio         = PRIO_RT;
+    g_tcb_ps.state        = READY;
+    g_tcb_ps.deadline     = PS_PERIOD;
+    g_tcb_ps.release_time = g_timer_count;
+    g_tcb_ps.timeout      = g_tcb_ps.release_time + g_tcb_ps.deadline;
+    g_ps_budget  = PS_BUDGET;
+    g_ps_serving = FALSE;
+    rt_queue_add(&g_tcb_ps);
+}
+
+/**
+ * @brief   park the polling server until its next period starts. The TIMER0
+ *          ISR releases it from timeout_list like any suspended RT task.
+ */
+static void ps_suspend(void)
+{
+    rt_queue_remove(&g_tcb_ps);
+    g_tcb_ps.state = SUSPENDED;
+    g_ps_budget = PS_BUDGET;
+
+    // a server kept from running past its period waits for the next one
+    while ((int)(g_tcb_ps.timeout - g_timer_count) <= 0) {
+        g_tcb_ps.timeout += g_tcb_ps.deadline;
+    }
+    timeout_list_add(&g_tcb_ps);
+}
+
+/*
+ * Function: k_ps_charge
+ * ----------------------------
+ *   Called by the TIMER0 ISR for the ticks that just passed. If a non-RT
+ *   task ran on the polling server, the ticks come off the budget and an
+ *   empty budget suspends the server.
+ *
+ *   returns: TRUE if the running task must be rescheduled.
+ */
+BOOL k_ps_charge(U32 ticks)
+{
+    if (!g_ps_serving) {
+        return FALSE;
+    }
+    if (ticks < g_ps_budget) {
+        g_ps_budget -= ticks;
+        return FALSE;
+    }
+    ps_suspend();
+    g_ps_serving = FALSE;
+    return TRUE;
+}
+
+/**
+ * @brief   put a ready non-RT task at the back of its priority level
+ */
+void ready_push(TCB *p_tcb)
+{
+    U32 level = p_tcb->prio - PRIO_OFFSET;
+
+    push_back(&prio_queue[level], (DNODE *)p_tcb);
+    g_ready_map |= BIT(31 - level);
+}
+
+/**
+ * @brief   take a non-RT task off its priority level
+ */
+void ready_remove(TCB *p_tcb)
+{
+    U32 level = p_tcb->prio - PRIO_OFFSET;
+
+    remove(&prio_queue[level], (DNODE *)p_tcb);
+    if (prio_queue[level].head == NULL) {
+        g_ready_map &= ~BIT(31 - level);
+    }
+}
+
+/**
+ * @brief   lowest TID at or above from that is free (free = TRUE) or in use
+ * @return  the TID, or MAX_TASKS if there is none
+ */
+static int tid_scan(int from, BOOL free)
+{
+    for (int w = from >> 5; w < TID_WORDS; w++) {
+        U32 bits = free ? g_tid_free[w] : ~g_tid_free[w];
+
+        if (w == (from >> 5)) {
+            bits &= ~0U << (from & 0x1F);
+        }
+        if (bits != 0) {
+            int tid = (w << 5) + 31 - clz(bits & (~bits + 1));
+            return (tid < MAX_TASKS) ? tid : MAX_TASKS;
+        }
+    }
+    return MAX_TASKS;
+}
+
+static void tid_take(task_t tid)
+{
+    g_tid_free[tid >> 5] &= ~BIT(tid & 0x1F);
+}
+
+static void tid_release(task_t tid)
+{
+    g_tid_free[tid >> 5] |= BIT(tid & 0x1F);
+}
+
+/**
+ * @brief   next TID at or above tid that is not free, MAX_TASKS if none
+ * @note    the system tasks are never free, a TID can be in use and DORMANT
+ *          only if its task failed to start
+ */
+int k_tsk_next(int tid)
+{
+    return tid_scan(tid, FALSE);
+}
+
+/**
+ * @brief   the TCB a task being created on tid goes in, NULL if there is no memory for it
+ */
+static TCB *tcb_take(task_t tid)
+{
+#if TCB_ON_DEMAND
+    if (g_tcb_table[tid] == &g_tcb_dormant) {
+        TCB *p_tcb = k_mpool_alloc(MPID_IRAM2, sizeof(TCB));
+
+        if (p_tcb == NULL) {
+            return NULL;
+        }
+        p_tcb->state = DORMANT;
+        p_tcb->mb.buf_start = NULL;
+        g_tcb_table[tid] = p_tcb;
+    }
+#endif
+    return &TCB_OF(tid);
+}
+
+/**
+ * @brief   give back the TCB of a task that exited or failed to start
+ * @note    an exiting task still saves its context into its TCB on the way
+ *          out, so an on-demand TCB is only freed by the next release
+ */
+static void tcb_release(task_t tid)
+{
+#if TCB_ON_DEMAND
+    static TCB *p_released = NULL;
+
+    k_mpool_dealloc(MPID_IRAM2, p_released);
+    p_released = g_tcb_table[tid];
+    g_tcb_table[tid] = &g_tcb_dormant;
+#endif
+}
+
+/**
+ * @brief   fill the words in [lo, hi) with STACK_PAINT
+ */
+static void stack_paint(U32 lo, U32 hi)
+{
+    for (U32 *p = (U32 *)((lo + 3) & ~3U); p < (U32 *)hi; p++) {
+        *p = STACK_PAINT;
+    }
+}
+
+/**
+ * @brief   bytes of a stack below its base that no longer hold STACK_PAINT
+ * @note    the paint is scanned up from the low end, so this is the deepest
+ *          the stack has ever grown, not its current depth
+ */
+static U32 stack_used(U32 base, U32 size)
+{
+    U32 *p = (U32 *)((base - size + 3) & ~3U);
+
+    while (p < (U32 *)base && *p == STACK_PAINT) {
+        p++;
+    }
+    return base - (U32)p;
+}
+
 
 /**************************************************************************//**
  * @brief   scheduler, pick the TCB of the next to run task
@@ -172,23 +465,22 @@ void timeout_list_add(TCB *p_tcb)
 
 TCB *scheduler(void)
 {
-	  if (rt_queue.head != NULL) {
-        return (TCB *) rt_queue.head;
-    }
-    if (prio_queue[0].head != NULL) {
-        return (TCB *) prio_queue[0].head;
-    }
-    if (prio_queue[1].head != NULL) {
-        return (TCB *) prio_queue[1].head;
-    }
-    if (prio_queue[2].head != NULL) {
-        return (TCB *) prio_queue[2].head;
+    g_ps_serving = FALSE;
+    while (g_rt_count != 0) {
+        if (g_rt_heap[0] != &g_tcb_ps) {
+            return g_rt_heap[0];
+        }
+        if (g_ready_map != 0) {
+            g_ps_serving = TRUE;
+            return (TCB *) prio_queue[clz(g_ready_map)].head;
+        }
+        ps_suspend();       // nothing to poll, the rest of the budget is lost
     }
-    if (prio_queue[3].head != NULL) {
-        return (TCB *) prio_queue[3].head;
+    if (g_ready_map != 0) {
+        return (TCB *) prio_queue[clz(g_ready_map)].head;
     }
 
-    return &g_tcbs[TID_NULL];
+    return &TCB_OF(TID_NULL);
 }
 
 /**
@@ -227,11 +519,53 @@ void k_tsk_init_wclck(TASK_INIT *p_task)
     p_task->u_stack_size = PROC_STACK_SIZE;
 }
 
+#if STATIC_ALLOC
+/**
+ * @brief   reserve the stacks and mailbox of every TID before any task is created
+ * @note    TIDs no boot task uses keep STATIC_STACK_SIZE for k_tsk_create,
+ *          mailbox sizes come from STATIC_MBX_PLAN or else STATIC_MBX_SIZE
+ */
+static int k_tsk_plan(TASK_INIT *task, int num_tasks)
+{
+    static const U32 mbx_plan[MAX_TASKS] = STATIC_MBX_PLAN;
+    
+    for (int tid = 0; tid < MAX_TASKS; tid++) {
+        U32 u_size   = STATIC_STACK_SIZE;
+        U32 mbx_size = (mbx_plan[tid] > 0) ? mbx_plan[tid] : STATIC_MBX_SIZE;
+        
+        if (tid == TID_NULL) {
+            u_size   = 0;       // allocated by k_pre_rtx_init
+            mbx_size = 0;
+        } else if (tid >= TID_WCLCK) {
+            u_size = PROC_STACK_SIZE;
+        } else if (tid <= num_tasks) {
+            u_size = task[tid - 1].u_stack_size;
+        }
+        if (u_size > 0 && u_size < PROC_STACK_SIZE) {
+            u_size = PROC_STACK_SIZE;
+        }
+        
+        if (k_mem_reserve(tid, u_size, mbx_size) != RTX_OK) {
+            printf("k_tsk_init: static plan does not fit, tid = %d, stack = 0x%x, mailbox = 0x%x\r\n",
+                   tid, u_size, mbx_size);
+            return RTX_ERR;
+        }
+    }
+    if (k_mem_seal() != RTX_OK) {
+        printf("k_tsk_init: static plan does not fit, %d kernel buffers of 0x%x\r\n",
+               STATIC_BUF_COUNT, STATIC_BUF_SIZE);
+        return RTX_ERR;
+    }
+    return RTX_OK;
+}
+#endif /* STATIC_ALLOC */
+
 /**************************************************************************//**
  * @brief       initialize all boot-time tasks in the system,
  *
  *
- * @return      RTX_OK on success; RTX_ERR on failure
+ * @return      RTX_OK on success; RTX_ERR on failure, which with
+ *              STATIC_ALLOC includes a plan that does not fit in memory
  * @param       task_info   boot-time task information structure pointer
  * @param       num_tasks   boot-time number of tasks
  * @pre         memory has been properly initialized
@@ -245,21 +579,43 @@ int k_tsk_init(TASK_INIT *task, int num_tasks)
     if (num_tasks > MAX_TASKS - 1) {
         return RTX_ERR;
     }
+#if STATIC_ALLOC
+    if (k_tsk_plan(task, num_tasks) != RTX_OK) {
+        return RTX_ERR;
+    }
+#endif
 
-    prio_queue[0].head = NULL;
-    prio_queue[1].head = NULL;
-    prio_queue[2].head = NULL;
-    prio_queue[3].head = NULL;
-		rt_queue.head = NULL;
+    for (int level = 0; level < PRIO_LEVELS; level++) {
+        prio_queue[level].head = NULL;
+        prio_queue[level].tail = NULL;
+    }
+    g_ready_map = 0;
+		g_rt_count = 0;
 		timeout_list.head = NULL;
+		if (g_sched == RM_PS) {
+			ps_init();
+		}
+    
+    // every TID between the null task and the system tasks starts out free
+    for (int w = 0; w < TID_WORDS; w++) {
+        g_tid_free[w] = 0;
+    }
+#if TCB_ON_DEMAND
+    for (int tid = TID_NULL + 1; tid < MAX_TASKS; tid++) {
+        g_tcb_table[tid] = &g_tcb_dormant;
+    }
+#endif
+    for (int tid = TID_NULL + 1; tid < TID_WCLCK; tid++) {
+        tid_release(tid);
+    }
     
     TASK_INIT taskinfo[4];
     
     // create and start NULL task
     k_tsk_init_null(&taskinfo[0]);
-    if ( k_tsk_create_new(&taskinfo[0], &g_tcbs[TID_NULL], TID_NULL) == RTX_OK ) {
+    if ( k_tsk_create_new(&taskinfo[0], &TCB_OF(TID_NULL), TID_NULL) == RTX_OK ) {
         g_num_active_tasks = 1;
-        gp_current_task = &g_tcbs[TID_NULL];
+        gp_current_task = &TCB_OF(TID_NULL);
     } else {
         g_num_active_tasks = 0;
         return RTX_ERR;
@@ -267,37 +623,37 @@ int k_tsk_init(TASK_INIT *task, int num_tasks)
 
     //create and start kcd and cdisp tasks
 		k_tsk_init_cdisp(&taskinfo[1]);
-    if ( k_tsk_create_new(&taskinfo[1], &g_tcbs[TID_CON], TID_CON) == RTX_OK ) {
-				TCB *p_tcb = &g_tcbs[TID_CON];
-				push_back(&prio_queue[g_tcbs[TID_CON].prio - PRIO_OFFSET], (DNODE *)p_tcb);
+    if ( tcb_take(TID_CON) != NULL && k_tsk_create_new(&taskinfo[1], &TCB_OF(TID_CON), TID_CON) == RTX_OK ) {
+				ready_push(&TCB_OF(TID_CON));
         g_num_active_tasks++;
     }
     k_tsk_init_kcd(&taskinfo[2]);
-    if ( k_tsk_create_new(&taskinfo[2], &g_tcbs[TID_KCD], TID_KCD) == RTX_OK ) {
-				TCB *p_tcb = &g_tcbs[TID_KCD];
-				push_back(&prio_queue[g_tcbs[TID_KCD].prio - PRIO_OFFSET], (DNODE *)p_tcb);
+    if ( tcb_take(TID_KCD) != NULL && k_tsk_create_new(&taskinfo[2], &TCB_OF(TID_KCD), TID_KCD) == RTX_OK ) {
+				ready_push(&TCB_OF(TID_KCD));
         g_num_active_tasks++;
     }
 		
 		//create and start WCLCK task
 		k_tsk_init_wclck(&taskinfo[3]);
-    if ( k_tsk_create_new(&taskinfo[3], &g_tcbs[TID_WCLCK], TID_WCLCK) == RTX_OK ) {
-				TCB *p_tcb = &g_tcbs[TID_WCLCK];
-				push_back(&prio_queue[g_tcbs[TID_WCLCK].prio - PRIO_OFFSET], (DNODE *)p_tcb);
+    if ( tcb_take(TID_WCLCK) != NULL && k_tsk_create_new(&taskinfo[3], &TCB_OF(TID_WCLCK), TID_WCLCK) == RTX_OK ) {
+				ready_push(&TCB_OF(TID_WCLCK));
         g_num_active_tasks++;
     }
     
     // create the rest of the tasks and push to ready queue
     for ( int i = 0; i < num_tasks; i++ ) {
-        TCB *p_tcb = &g_tcbs[i+1];
-        if (k_tsk_create_new(&task[i], p_tcb, i+1) == RTX_OK) {
-            push_back(&prio_queue[p_tcb->prio - PRIO_OFFSET], (DNODE *)p_tcb);
+        TCB *p_tcb = tcb_take(i+1);
+        if (p_tcb != NULL && k_tsk_create_new(&task[i], p_tcb, i+1) == RTX_OK) {
+            tid_take(i+1);
+            ready_push(p_tcb);
             g_num_active_tasks++;
+        } else if (p_tcb != NULL) {
+            tcb_release(i+1);
         }
     }
 		
 		for ( int i = 0; i < MAX_TASKS; i++ ) {
-			g_tcbs[i].mb.buf_start = NULL;
+			TCB_OF(i).mb.buf_start = NULL;
 		}
     
     return RTX_OK;
@@ -360,6 +716,10 @@ int k_tsk_create_new(TASK_INIT *p_taskinfo, TCB *p_tcb, task_t tid)
 
     p_tcb->u_sp_base = (U32)usp;
 
+    // the NULL task is created on its own user stack, keep the live frames above PSP
+    stack_paint(p_tcb->u_sp_base - p_tcb->u_stack_size,
+                (tid == TID_NULL) ? __get_PSP() : p_tcb->u_sp_base);
+
     /*-------------------------------------------------------------------
      *  Step2: create task's thread mode initial context on the user stack.
      *         fabricate the stack so that the stack looks like that
@@ -388,6 +748,13 @@ int k_tsk_create_new(TASK_INIT *p_taskinfo, TCB *p_tcb, task_t tid)
 #endif
     }
 
+#if SHARED_K_STACK
+    // R4-R11, restored from below the exception frame when the task is switched in
+    for ( int j = 0; j < 8; j++ ) {
+        *(--usp) = 0x0;
+    }
+#endif
+
     p_tcb->u_sp = (U32)usp;
     
     // allocate kernel stack for the task
@@ -397,6 +764,14 @@ int k_tsk_create_new(TASK_INIT *p_taskinfo, TCB *p_tcb, task_t tid)
     }
     
     p_tcb->k_sp_base = (U32)ksp;
+#if SHARED_K_STACK
+    // later tasks are created while the shared stack is in use
+    if (tid == TID_NULL) {
+        stack_paint(p_tcb->k_sp_base - p_tcb->k_stack_size, p_tcb->k_sp_base);
+    }
+    p_tcb->cont = NULL;
+#else
+    stack_paint(p_tcb->k_sp_base - p_tcb->k_stack_size, p_tcb->k_sp_base);
 
     /*---------------------------------------------------------------
      *  Step3: create task kernel initial context on kernel stack
@@ -425,6 +800,7 @@ int k_tsk_create_new(TASK_INIT *p_taskinfo, TCB *p_tcb, task_t tid)
     } else {                      // unprivileged
         *(--ksp) = __get_CONTROL() | BIT(0);
     }
+#endif
 
     p_tcb->msp = ksp;
     p_tcb->state = READY;
@@ -432,6 +808,57 @@ int k_tsk_create_new(TASK_INIT *p_taskinfo, TCB *p_tcb, task_t tid)
     return RTX_OK;
 }
 
+#if SHARED_K_STACK
+/**************************************************************************//**
+ * @brief       with a shared kernel stack there is nothing to switch here.
+ *              Thread registers are saved by the trap entry in HAL.c and
+ *              the trap exit loads the context of gp_current_task.
+ *****************************************************************************/
+void k_tsk_switch(TCB *p_tcb_old)
+{
+    return;
+}
+
+/**************************************************************************//**
+ * @brief       leave rtx_init on the shared kernel stack and enter the first task
+ *****************************************************************************/
+__asm void k_tsk_start(void)
+{
+        PRESERVE8
+        IMPORT  K_SWITCH_IN
+        LDR     R1, =__cpp(&gp_current_task)
+        LDR     R1, [R1]
+        LDR     R0, [R1, #TCB_MSP_OFFSET]   // every msp is the base of the shared stack
+        MOV     SP, R0
+        MVN     LR, #:NOT:0xFFFFFFFD        // EXC_RETURN value, Thread mode, PSP
+        B       K_SWITCH_IN
+}
+
+/**************************************************************************//**
+ * @brief       run the continuations of blocked calls until the task to
+ *              switch in has none left
+ * @note        called by the trap exit before the context of
+ *              gp_current_task is loaded. A continuation may block again,
+ *              which makes another task current.
+ *****************************************************************************/
+void k_tsk_resume(void)
+{
+    TCB *p_tcb;
+
+    while ((p_tcb = gp_current_task)->cont != NULL) {
+        int (*cont)(U32 *) = p_tcb->cont;
+        U32 *args = (U32 *)(p_tcb->u_sp) + 8;      // stacked R0-R3 above the saved R4-R11
+
+        p_tcb->cont = NULL;
+        int ret = cont(args);
+        if (p_tcb->cont == NULL) {
+            args[0] = ret;
+        }
+    }
+}
+
+#else
+
 /**************************************************************************//**
  * @brief       switching kernel stacks of two TCBs
  * @param       p_tcb_old, the old tcb that was in RUNNING
@@ -476,6 +903,7 @@ __asm void k_tsk_start(void)
         PRESERVE8
         B K_RESTORE
 }
+#endif
 
 /**************************************************************************//**
  * @brief       run a new thread. The caller becomes READY and
@@ -498,8 +926,8 @@ int k_tsk_run_new(BOOL voluntary)
 	  // push old task to end of its queue if voluntary
     p_tcb_old = gp_current_task;
     if (voluntary && p_tcb_old->tid != TID_NULL) {
-				pop_front(&prio_queue[p_tcb_old->prio - PRIO_OFFSET]);
-        push_back(&prio_queue[p_tcb_old->prio - PRIO_OFFSET], (DNODE *)p_tcb_old);
+				ready_remove(p_tcb_old);
+        ready_push(p_tcb_old);
     }
 
     gp_current_task = scheduler();
@@ -511,7 +939,7 @@ int k_tsk_run_new(BOOL voluntary)
 					  p_tcb_old->state = READY;  			// change state of the to-be-switched-out tcb (only if not blocked)
 				};
 				
-				#ifdef DEBUG_2
+				#if defined(DEBUG_2) && !SHARED_K_STACK
 					p_tcb_old->u_sp = (U32)__get_PSP();
 					if (p_tcb_old->u_sp_base - p_tcb_old->u_sp > p_tcb_old->u_stack_size) {
 						printf("Task %u stack overflow.\n\r", p_tcb_old->tid);
@@ -542,6 +970,26 @@ int k_tsk_yield(void)
     return k_tsk_run_new(VOLUNTARY);
 }
 
+/*
+ * Function: k_tsk_idle
+ * ----------------------------
+ *   Called by the null task before it sleeps. With TICKLESS_IDLE, when no
+ *   other task is ready, TIMER0 is set to fire only at the next timeout_list
+ *   expiry instead of every tick.
+ *
+ *   returns: 1 if the tick is stopped and the caller may WFI, 0 otherwise.
+ */
+int k_tsk_idle(void)
+{
+#if TICKLESS_IDLE
+    timer_idle_exit();          // woken by something other than TIMER0 or UART0
+    if (gp_current_task->tid == TID_NULL && g_rt_count == 0 && g_ready_map == 0) {
+        return timer_idle_enter();
+    }
+#endif
+    return 0;
+}
+
 /**
  * @brief   get task identification
  * @return  the task ID (TID) of the calling task
@@ -569,15 +1017,18 @@ int k_tsk_create(task_t *task, void (*task_entry)(void), U8 prio, U32 stack_size
       return RTX_ERR;
     }
 
-    for (*task = 1; *task < 10; ++*task) {
-        if (g_tcbs[*task].state == DORMANT) { //Check if state init to 0 on board
-            break;
-        }
+    int tid = tid_scan(TID_NULL + 1, TRUE);
+#if STATIC_ALLOC
+    // only a TID whose reserved stack is big enough will do
+    while (tid < MAX_TASKS && !k_mem_slot_fits(tid, (stack_size < PROC_STACK_SIZE) ? PROC_STACK_SIZE : stack_size)) {
+        tid = tid_scan(tid + 1, TRUE);
     }
-    if (*task == MAX_TASKS) {
+#endif
+    if (tid == MAX_TASKS) {
         errno = EAGAIN;
         return RTX_ERR;
     }
+    *task = tid;
 
     TASK_INIT p_task_info;
     p_task_info.tid = *task;
@@ -586,11 +1037,17 @@ int k_tsk_create(task_t *task, void (*task_entry)(void), U8 prio, U32 stack_size
     p_task_info.ptask = task_entry;
     p_task_info.priv = 0;
 
-    TCB *p_tcb = &g_tcbs[*task];
+    TCB *p_tcb = tcb_take(*task);
+    if (p_tcb == NULL) {
+        errno = ENOMEM;
+        return RTX_ERR;
+    }
     if (k_tsk_create_new(&p_task_info, p_tcb, *task) != RTX_OK) {
+        tcb_release(*task);
         return RTX_ERR;
     };
-    push_back(&prio_queue[p_tcb->prio - PRIO_OFFSET], (DNODE *)p_tcb);
+    tid_take(*task);
+    ready_push(p_tcb);
 
     g_num_active_tasks++;
     k_tsk_run_new(INVOLUNTARY);
@@ -606,43 +1063,44 @@ void k_tsk_exit(void)
 #endif /* DEBUG_0 */
     TCB *p_tcb_old = gp_current_task;
 		if (p_tcb_old->prio == PRIO_RT) {
-			pop_front(&rt_queue);
+			rt_queue_remove(p_tcb_old);
 		}
 		else {
-			pop_front(&prio_queue[p_tcb_old->prio - PRIO_OFFSET]);
+			ready_remove(p_tcb_old);
 		}
 	
 		//Delete mailbox and unblock all waiting tasks
 		if (p_tcb_old->mb.buf_start != NULL) {
 			
-				for (int prio = 0; prio < 4; ++prio) {
-					
-						TCB *traverse = (TCB *)p_tcb_old->mb.wait_list[prio].head;
-						while (traverse != NULL) {
+				TCB *traverse;
+				while ((traverse = (TCB *)pop_front(&p_tcb_old->mb.wait_list)) != NULL) {
 							
-							traverse->state = READY;
-							remove(&p_tcb_old->mb.wait_list[prio], (DNODE *)traverse);
-							if (traverse->prio == PRIO_RT) {
-								rt_queue_add(traverse);
-							}
-							else {
-								push_back(&prio_queue[traverse->prio - PRIO_OFFSET], (DNODE *)traverse);
-							}
-							traverse = traverse->next;
+						traverse->state = READY;
+						if (traverse->prio == PRIO_RT) {
+							rt_queue_add(traverse);
+						}
+						else {
+							ready_push(traverse);
 						}
 				}
-				k_mpool_dealloc(MPID_IRAM2, p_tcb_old->mb.buf_start);
+				k_dealloc_mbx(p_tcb_old->tid, p_tcb_old->mb.buf_start);
 				p_tcb_old->mb.buf_start = NULL;
 		}
 		
+		//Free the heap blocks the task still owns, then return its cached ones to IRAM1
+		k_heap_reclaim(p_tcb_old->tid);
+		k_mag_flush(p_tcb_old->tid);
+		
 		//Dealloc user and kernel stacks
-		void *stack_address = (void *) (p_tcb_old->u_sp_base - p_tcb_old->u_stack_size);
-    k_mpool_dealloc(MPID_IRAM2, stack_address);
-		stack_address = (void *) (p_tcb_old->k_sp_base - p_tcb_old->k_stack_size);
-		k_mpool_dealloc(MPID_IRAM2, stack_address);
+		k_dealloc_stack(p_tcb_old->u_sp_base, p_tcb_old->u_stack_size);
+#if !SHARED_K_STACK
+		k_dealloc_stack(p_tcb_old->k_sp_base, p_tcb_old->k_stack_size);
+#endif
 		
     p_tcb_old->state = DORMANT;
     g_num_active_tasks--;
+    tid_release(p_tcb_old->tid);
+    tcb_release(p_tcb_old->tid);
 
     gp_current_task = scheduler();
     gp_current_task->state = RUNNING;
@@ -657,7 +1115,11 @@ int k_tsk_set_prio(task_t task_id, U8 prio)
     printf("k_tsk_set_prio: entering...\n\r");
     printf("task_id = %d, prio = %d.\n\r", task_id, prio);
 #endif /* DEBUG_0 */
-    TCB *p_tcb = &g_tcbs[task_id];
+    if (task_id >= MAX_TASKS) {
+      errno = EINVAL;
+      return RTX_ERR;
+    }
+    TCB *p_tcb = &TCB_OF(task_id);
     if ((p_tcb->state == DORMANT) || (p_tcb->prio == prio)) {
       return RTX_OK;
     }
@@ -671,17 +1133,17 @@ int k_tsk_set_prio(task_t task_id, U8 prio)
     }
 		
 		if (p_tcb->state == BLK_SEND) {
-			remove(&p_tcb->blocked_on->mb.wait_list[p_tcb->prio - PRIO_OFFSET], (DNODE *)p_tcb);
+			remove(&p_tcb->blocked_on->mb.wait_list, (DNODE *)p_tcb);
 			p_tcb->prio = prio;
-			push_back(&p_tcb->blocked_on->mb.wait_list[prio - PRIO_OFFSET], (DNODE *)p_tcb);
+			waitlist_add(&p_tcb->blocked_on->mb.wait_list, p_tcb);
 		}
 		else if (p_tcb->state == BLK_RECV) {
 			p_tcb->prio = prio;
 		}
 		else {
-			remove(&prio_queue[p_tcb->prio - PRIO_OFFSET], (DNODE *)p_tcb);
+			ready_remove(p_tcb);
 			p_tcb->prio = prio;
-			push_back(&prio_queue[prio - PRIO_OFFSET], (DNODE *)p_tcb);
+			ready_push(p_tcb);
 
 			k_tsk_run_new(INVOLUNTARY);
 		}
@@ -707,7 +1169,7 @@ int k_tsk_get(task_t tid, RTX_TASK_INFO *buffer)
         return RTX_ERR;
     }
 		
-		TCB *task_tcb = &g_tcbs[tid];
+		TCB *task_tcb = &TCB_OF(tid);
     
     buffer->tid           = tid;
     buffer->prio          = task_tcb->prio;
@@ -728,6 +1190,16 @@ int k_tsk_get(task_t tid, RTX_TASK_INFO *buffer)
         buffer->u_sp = task_tcb->u_sp;
     }
 
+    if (task_tcb->state == DORMANT) {
+        buffer->max_u_stack_used = 0;
+        buffer->max_k_stack_used = 0;
+    }
+    else {
+        buffer->max_u_stack_used = stack_used(task_tcb->u_sp_base, task_tcb->u_stack_size);
+        buffer->max_k_stack_used = stack_used(task_tcb->k_sp_base, task_tcb->k_stack_size);
+    }
+    buffer->heap_used = k_heap_used(tid, &buffer->heap_blocks);
+
     return RTX_OK;     
 }
 
@@ -743,9 +1215,9 @@ int k_tsk_ls(task_t *buf, size_t count)
     }
 
     int tasks = 0;
-    for (int i = 0; i < MAX_TASKS && tasks <= count; ++i) {
-        if (g_tcbs[i].state != DORMANT) {
-            buf[tasks] = g_tcbs[i].tid;
+    for (int i = k_tsk_next(0); i < MAX_TASKS && tasks < count; i = k_tsk_next(i + 1)) {
+        if (TCB_OF(i).state != DORMANT) {
+            buf[tasks] = TCB_OF(i).tid;
             ++tasks;
         }
     }
@@ -770,16 +1242,17 @@ int k_rt_tsk_set(TIMEVAL *p_tv)
 		return RTX_ERR;
 	}
 	
-	pop_front(&prio_queue[p_tcb->prio - PRIO_OFFSET]);
-	
-	// Queue should be empty
-	push_back(&rt_queue, (DNODE *) p_tcb);
+	ready_remove(p_tcb);
 	
 	p_tcb->prio = PRIO_RT;
 	p_tcb->state = RUNNING;
 	p_tcb->deadline = usec_period / RTX_TICK_SIZE;
 	p_tcb->release_time = g_timer_count;
 	p_tcb->timeout = p_tcb->release_time + p_tcb->deadline;
+	
+	// under RM_PS the caller may have run on the polling server, pick again
+	rt_queue_add(p_tcb);
+	k_tsk_run_new(INVOLUNTARY);
 
     return RTX_OK;   
 }
@@ -795,20 +1268,23 @@ int k_rt_tsk_susp(void)
 		return RTX_ERR;
 	}
 	
-	// if deadline not missed, suspend.
+	// if the deadline is still ahead, suspend until it.
 	// else, immediately add task to rt_queue
-	if (p_tcb->timeout >= g_timer_count) {
+	// (signed distance, g_timer_count may have wrapped)
+	if ((int)(p_tcb->timeout - g_timer_count) > 0) {
 		
-		pop_front(&rt_queue);
+		rt_queue_remove(p_tcb);
 		p_tcb->state = SUSPENDED;	
 		
 		timeout_list_add(p_tcb);
 		
 		k_tsk_run_new(INVOLUNTARY);
+#if !SHARED_K_STACK
 		p_tcb->state = RUNNING; // Wake up
+#endif
 	}
 	else {
-		pop_front(&rt_queue);
+		rt_queue_remove(p_tcb);
 
 		p_tcb->state = READY;
 		p_tcb->release_time = g_timer_count;
@@ -828,7 +1304,11 @@ int k_rt_tsk_get(task_t tid, TIMEVAL *buffer)
     printf("k_rt_tsk_get: entering...\n\r");
     printf("tid = %d, buffer = 0x%x.\n\r", tid, buffer);
 #endif /* DEBUG_0 */    
-		TCB *p_tcb = &g_tcbs[tid];
+		if (tid >= MAX_TASKS) {
+			errno = EINVAL;
+			return RTX_ERR;
+		}
+		TCB *p_tcb = &TCB_OF(tid);
 		if (p_tcb->prio != PRIO_RT) {
 			errno = EINVAL;
 			return RTX_ERR;
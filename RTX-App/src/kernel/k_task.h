@@ -81,9 +81,11 @@ TCB  *scheduler         (void);  /* return the TCB of the next ready to run task
 void k_tsk_switch       (TCB *); /* kernel thread context switch, two stacks */
 int  k_tsk_run_new(BOOL voluntary); /* kernel runs a new thread  */
 int  k_tsk_yield        (void);  /* kernel tsk_yield function */
+int  k_tsk_idle         (void);  /* stop the tick if the null task is the only one to run */
 void task_null          (void);  /* the null task */
 void k_tsk_init_first   (TASK_INIT *p_task);    /* init the first task */
 void k_tsk_start        (void);  /* start the first task */
+void k_tsk_resume       (void);  /* run continuations of blocked calls, SHARED_K_STACK only */
 task_t k_tsk_gettid     (void);  /* get tid of the current running task */
 
 // Not implemented, to be done by students
@@ -98,7 +100,13 @@ int  k_rt_tsk_set       (TIMEVAL *p_tv);
 int  k_rt_tsk_susp      (void);
 int  k_rt_tsk_get       (task_t task_id, TIMEVAL *buffer);
 void rt_queue_add(TCB *p_tcb);
+void rt_queue_remove(TCB *p_tcb);
+BOOL rt_before(TCB *a, TCB *b);
+int  k_tsk_next(int tid);
+void ready_push(TCB *p_tcb);
+void ready_remove(TCB *p_tcb);
 void timeout_list_add(TCB *p_tcb);
+BOOL k_ps_charge(U32 ticks);
 #endif // ! K_TASK_H_
 
 /*
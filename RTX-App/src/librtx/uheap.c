@@ -0,0 +1,180 @@
+#include "uheap.h"
+#include "rtx.h"
+#include "rtx_errno.h"
+#include "math.h"
+
+#define UHEAP_MIN_SHIFT 3       /* log2(UHEAP_MIN_OBJ) */
+
+#if (UHEAP_CHUNK_SIZE & (UHEAP_CHUNK_SIZE - 1)) != 0 || UHEAP_CHUNK_SIZE > 2048
+#error "UHEAP_CHUNK_SIZE must be a power of two of at most 2048"
+#endif
+
+typedef struct uchunk
+{
+    DNODE   node;               /* in the class list, must come first */
+    void   *free;               /* free objects, linked through their first word */
+    U8      cls;
+    U8      used;
+    U16     skew;               /* bytes from the block mem_alloc returned up to the chunk */
+} UCHUNK;
+
+static int size_class(size_t size)
+{
+    return (size <= UHEAP_MIN_OBJ) ? 0 : 32 - clz((size - 1) >> UHEAP_MIN_SHIFT);
+}
+
+static U32 chunk_slot(UCHUNK *chunk)
+{
+    return ((U32)chunk - RAM1_START) / UHEAP_CHUNK_SIZE;
+}
+
+/*
+ * A buddy IRAM1 hands out blocks aligned to their size. Any other allocator
+ * may not, then twice the size is taken and the chunk starts at the first
+ * aligned address in it.
+ */
+static UCHUNK *chunk_new(UHEAP *heap, int cls)
+{
+    U8 *block = mem_alloc(UHEAP_CHUNK_SIZE);
+    if (block != NULL && ((U32)block & (UHEAP_CHUNK_SIZE - 1)) != 0) {
+        mem_dealloc(block);
+        block = mem_alloc(UHEAP_CHUNK_SIZE << 1);
+    }
+    if (block == NULL) {
+        return NULL;
+    }
+
+    UCHUNK *chunk = (UCHUNK *)(((U32)block + UHEAP_CHUNK_SIZE - 1) & ~(UHEAP_CHUNK_SIZE - 1));
+    U32 obj_size = UHEAP_MIN_OBJ << cls;
+    U32 count = (UHEAP_CHUNK_SIZE - sizeof(UCHUNK)) / obj_size;
+    U8 *obj = (U8 *)(chunk + 1) + (count - 1) * obj_size;
+    U32 slot = chunk_slot(chunk);
+
+    chunk->free = NULL;
+    chunk->cls = cls;
+    chunk->used = 0;
+    chunk->skew = (U8 *)chunk - block;
+    heap->chunk_map[slot >> 5] |= 1U << (slot & 31);
+
+    // link from the top so objects are handed out from the bottom up
+    for (U32 i = 0; i < count; i++, obj -= obj_size) {
+        *(void **)obj = chunk->free;
+        chunk->free = obj;
+    }
+    return chunk;
+}
+
+static int chunk_delete(UHEAP *heap, UCHUNK *chunk)
+{
+    U32 slot = chunk_slot(chunk);
+
+    heap->chunk_map[slot >> 5] &= ~(1U << (slot & 31));
+    return mem_dealloc((U8 *)chunk - chunk->skew);
+}
+
+/* the chunk of the slot ptr is in, or NULL if the heap has no chunk there */
+static UCHUNK *chunk_of(UHEAP *heap, void *ptr)
+{
+    if ((U32)ptr < RAM1_START || (U32)ptr > RAM1_END) {
+        return NULL;
+    }
+
+    UCHUNK *chunk = (UCHUNK *)((U32)ptr & ~(UHEAP_CHUNK_SIZE - 1));
+    U32 slot = chunk_slot(chunk);
+
+    return (heap->chunk_map[slot >> 5] & (1U << (slot & 31))) ? chunk : NULL;
+}
+
+void uheap_init(UHEAP *heap)
+{
+    for (int cls = 0; cls < UHEAP_CLASSES; cls++) {
+        heap->chunks[cls].head = NULL;
+        heap->chunks[cls].tail = NULL;
+    }
+    for (U32 i = 0; i < sizeof(heap->chunk_map) / sizeof(U32); i++) {
+        heap->chunk_map[i] = 0;
+    }
+}
+
+void *uheap_alloc(UHEAP *heap, size_t size)
+{
+    if (size == 0) {
+        return NULL;
+    }
+    if (size > UHEAP_MAX_OBJ) {
+        return mem_alloc(size);
+    }
+
+    int cls = size_class(size);
+    DLIST *list = &heap->chunks[cls];
+    UCHUNK *chunk = (UCHUNK *)list->head;
+
+    // full chunks are kept last, so a full head means every chunk is full
+    if (chunk == NULL || chunk->free == NULL) {
+        chunk = chunk_new(heap, cls);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        push_front(list, &chunk->node);
+    }
+
+    void *obj = chunk->free;
+    chunk->free = *(void **)obj;
+    chunk->used++;
+
+    if (chunk->free == NULL && chunk->node.next != NULL) {
+        remove(list, &chunk->node);
+        push_back(list, &chunk->node);
+    }
+    return obj;
+}
+
+int uheap_free(UHEAP *heap, void *ptr)
+{
+    if (ptr == NULL) {
+        return RTX_OK;
+    }
+
+    UCHUNK *chunk = chunk_of(heap, ptr);
+    if (chunk == NULL) {
+        return mem_dealloc(ptr);
+    }
+
+    // only the start of one of the chunk's objects can be freed
+    U32 obj_size = UHEAP_MIN_OBJ << chunk->cls;
+    U32 count = (UHEAP_CHUNK_SIZE - sizeof(UCHUNK)) / obj_size;
+    U32 offset = (U32)ptr - (U32)(chunk + 1);
+    if ((U8 *)ptr < (U8 *)(chunk + 1) || (offset & (obj_size - 1)) != 0 || offset >= count * obj_size) {
+        errno = EFAULT;
+        return RTX_ERR;
+    }
+
+    DLIST *list = &heap->chunks[chunk->cls];
+    BOOL was_full = (chunk->free == NULL);
+
+    *(void **)ptr = chunk->free;
+    chunk->free = ptr;
+    chunk->used--;
+
+    // an empty chunk goes back to the kernel unless it is the last one of its class
+    if (chunk->used == 0 && (list->head != &chunk->node || chunk->node.next != NULL)) {
+        remove(list, &chunk->node);
+        return chunk_delete(heap, chunk);
+    }
+    if (was_full && list->head != &chunk->node) {
+        remove(list, &chunk->node);
+        push_front(list, &chunk->node);
+    }
+    return RTX_OK;
+}
+
+/* returns every chunk to the kernel, blocks larger than UHEAP_MAX_OBJ are not tracked */
+void uheap_destroy(UHEAP *heap)
+{
+    for (int cls = 0; cls < UHEAP_CLASSES; cls++) {
+        DNODE *node;
+        while ((node = pop_front(&heap->chunks[cls])) != NULL) {
+            chunk_delete(heap, (UCHUNK *)node);
+        }
+    }
+}
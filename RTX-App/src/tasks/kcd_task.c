@@ -19,15 +19,21 @@ U8 cached_cmd[KCD_CMD_BUF_SIZE];
 U8 cached_cmd_len = 0;
 BOOL active_cmd = FALSE;
 
-char LT_msg[] = "TID: x, STATE: x\n\r";
-char LM_msg[] = "TID: x, STATE: x, FREE:      \n\r";
+char LT_msg[] = "TID: x  , STATE: x\n\r";
+char LM_msg[] = "TID: x  , STATE: x, FREE:      \n\r";
+char LS_msg[] = "TID: x  , USTK:      , KSTK:      \n\r";
 char cmd_nf[] = "Command not found.\n\r";
 char cmd_inv[] = "Invalid command.\n\r";
-U8 tid_index = 5;
-U8 state_index = 15;
-U8 free_index = 23;
-U8 LT_msg_len = 18;
-U8 LM_msg_len = 31;
+U8 tid_index = 4;
+U8 state_index = 17;
+U8 free_index = 25;
+U8 ustk_index = 15;
+U8 kstk_index = 28;
+U8 tid_width = 3;       // a task_t has at most 3 digits
+U8 num_width = 5;
+U8 LT_msg_len = 20;
+U8 LM_msg_len = 33;
+U8 LS_msg_len = 36;
 U8 cmd_nf_len = 20;
 U8 cmd_inv_len = 18;
  
@@ -79,6 +85,17 @@ U8* prep_disp_msg(U8 len)
 		return default_msg;
 }
 
+void put_num(U8 *msg, U8 index, U32 num, U8 width)
+{
+		U8 digits = num_places(num);
+		for (int j = 0; j < digits; ++j) {
+			msg[index + digits - j] = '0' + get_digit(num, j);
+		}
+		for (int j = digits; j < width; ++j) {
+			msg[index + j + 1] = (char)0x20;
+		}
+}
+
 void run_LM()
 {	
 		U8 *default_msg = prep_disp_msg(LM_msg_len);							
@@ -86,19 +103,13 @@ void run_LM()
 			default_msg[i] = LM_msg[i];
 		}
 						
-		for (int i = 0; i < MAX_TASKS; ++i) {
+		for (int i = k_tsk_next(0); i < MAX_TASKS; i = k_tsk_next(i + 1)) {
 							
-			if (g_tcbs[i].state != DORMANT && g_tcbs[i].mb.buf_start != NULL) {
+			if (TCB_OF(i).state != DORMANT && TCB_OF(i).mb.buf_start != NULL) {
 								
-				default_msg[tid_index] = '0' + g_tcbs[i].tid;
-				default_msg[state_index] = '0' + g_tcbs[i].state;	
-				U8 digits = num_places(g_tcbs[i].mb.space);
-				for (int j = 0; j < digits; ++j) {
-					default_msg[free_index + digits - j] = '0' + get_digit(g_tcbs[i].mb.space, j);
-				}
-				for (int j = digits; j < 5; ++j) {
-					default_msg[free_index + j + 1] = (char)0x20;
-				}
+				put_num(default_msg, tid_index, TCB_OF(i).tid, tid_width);
+				default_msg[state_index] = '0' + TCB_OF(i).state;	
+				put_num(default_msg, free_index, TCB_OF(i).mb.space, num_width);
 
 				send_msg(TID_CON, default_msg - MSG_HDR_SIZE);
 			}
@@ -113,12 +124,33 @@ void run_LT()
 			default_msg[i] = LT_msg[i];
 		}
 						
-		for (int i = 0; i < MAX_TASKS; ++i) {
+		for (int i = k_tsk_next(0); i < MAX_TASKS; i = k_tsk_next(i + 1)) {
+							
+			if (TCB_OF(i).state != DORMANT) {
+								
+				put_num(default_msg, tid_index, TCB_OF(i).tid, tid_width);
+				default_msg[state_index] = '0' + TCB_OF(i).state;
+				send_msg(TID_CON, default_msg - MSG_HDR_SIZE);
+			}
+		}
+		k_mpool_dealloc(MPID_IRAM2, default_msg - MSG_HDR_SIZE);
+}
+
+void run_LS()
+{
+		RTX_TASK_INFO info;
+		U8 *default_msg = prep_disp_msg(LS_msg_len);
+		for (int i = 0; i < LS_msg_len; ++i) {
+			default_msg[i] = LS_msg[i];
+		}
+						
+		for (int i = k_tsk_next(0); i < MAX_TASKS; i = k_tsk_next(i + 1)) {
 							
-			if (g_tcbs[i].state != DORMANT) {
+			if (TCB_OF(i).state != DORMANT && k_tsk_get(i, &info) == RTX_OK) {
 								
-				default_msg[tid_index] = '0' + g_tcbs[i].tid;
-				default_msg[state_index] = '0' + g_tcbs[i].state;
+				put_num(default_msg, tid_index, info.tid, tid_width);
+				put_num(default_msg, ustk_index, info.max_u_stack_used, num_width);
+				put_num(default_msg, kstk_index, info.max_k_stack_used, num_width);
 				send_msg(TID_CON, default_msg - MSG_HDR_SIZE);
 			}
 		}
@@ -128,7 +160,7 @@ void run_LT()
 BOOL cmd_exist(U8* key_tid)
 {
 	if (key_tid) {
-		if (g_tcbs[*key_tid].state != DORMANT && *key_tid != 0) {
+		if (*key_tid < MAX_TASKS && TCB_OF(*key_tid).state != DORMANT && *key_tid != 0) {
 			return TRUE;
 		}
 	}
@@ -167,6 +199,7 @@ void task_kcd(void)
 						
 						if (cached_cmd[0] == 'L' && cached_cmd[1] == 'M' && cached_cmd_len == 2) run_LM();
 						else if (cached_cmd[0] == 'L' && cached_cmd[1] == 'T' && cached_cmd_len == 2) run_LT();
+						else if (cached_cmd[0] == 'L' && cached_cmd[1] == 'S' && cached_cmd_len == 2) run_LS();
 						else if (cached_cmd[0] != 'L') { // Send cmd to task
 							U8 *task_msg = k_mpool_alloc(MPID_IRAM2, MSG_HDR_SIZE + cached_cmd_len);
 					
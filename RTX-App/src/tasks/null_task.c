@@ -51,6 +51,12 @@ void task_null(void)
         for ( int i = 0; i < 5; i++ ){
             printf("==============Task NULL: TID = %d ===============\r\n", tid);
         }
+#endif
+        mem_idle();
+#if TICKLESS_IDLE
+        if (tsk_idle() == 1) {
+            __WFI();            // the next timeout or a UART interrupt wakes us
+        }
 #endif
         tsk_yield();
     }
@@ -73,6 +73,11 @@ typedef struct tm_tick {
 extern uint32_t timer_irq_init      (uint8_t n_timer);  /* interrupt-driven */
 extern uint32_t timer_freerun_init  (uint8_t n_timer);  /* free running     */
 extern int      get_tick            (TM_TICK *tk, uint8_t n_timer); 
+extern int      timer_idle_enter    (void);             /* stretch TIMER0 to the next timeout, TICKLESS_IDLE */
+extern void     timer_idle_exit     (void);             /* account the ticks slept, back to 500 us */
+#if SHARED_K_STACK
+extern void     k_timer0_handler    (void);             /* TIMER0 IRQ body, entered through K_TRAP */
+#endif
 
 #endif /* ! _TIMER_H_ */
 
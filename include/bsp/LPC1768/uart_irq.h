@@ -59,6 +59,9 @@ extern MAILBOX uart_mb;
 
 
 int uart_irq_init(int n_uart);		// initialize the n_uart to use interrupt
+#if SHARED_K_STACK
+void k_uart0_handler(void);		// UART0 IRQ body, entered through K_TRAP
+#endif
 
 #endif // ! UART_IRQ_H_ 
 
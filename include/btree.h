@@ -1,16 +1,92 @@
+#ifndef BTREE_H_
+#define BTREE_H_
+
 #include "lpc1768_mem.h"
 #include "common.h"
 #include "math.h"
 
-unsigned int get_buddy(unsigned int level, unsigned int position);
-unsigned int get_parent(unsigned int level, unsigned int position);
-unsigned int get_left_child(unsigned int level, unsigned int position);
-unsigned int get_right_child(unsigned int level, unsigned int position);
-unsigned int get_position(mpool_t mpid, void *addr, unsigned int level);
-unsigned int get_index(unsigned int level, unsigned int position);
-unsigned int get_offset(unsigned int index);
-BOOL is_allocated(U8 *bit_tree, unsigned int index);
-void clear_bit(U8 *bit_tree, unsigned int index);
-void set_bit(U8 *bit_tree, unsigned int index);
-void *get_address(mpool_t mpid, unsigned int level, unsigned int position);
-void *split_addr(mpool_t mpid, unsigned int level, void *start_addr);
+/*
+ * Buddy tree geometry.
+ * A pool of 2^power bytes at base is a complete binary tree whose nodes are
+ * numbered level by level from the root (index 0); a node at (level, position)
+ * covers 2^(power - level) bytes. Every helper below is an inline shift or
+ * mask on the pool's base and power, with no loops or divisions, so where
+ * base and power are constants at the call site (the IRAM pools, see
+ * buddy_alloc in k_mem.c) the compiler folds the layout away.
+ */
+
+/* size in bytes of a block at level */
+static __inline unsigned int get_block_size(unsigned int power, unsigned int level)
+{
+	return 1U << (power - level);
+}
+
+/* deepest level whose blocks hold size bytes, size >= MIN_BLK_SIZE */
+static __inline unsigned int get_level(unsigned int power, unsigned int size)
+{
+	return power - (32 - clz(size - 1));
+}
+
+static __inline unsigned int get_index(unsigned int level, unsigned int position)
+{
+	return (1U << level) - 1 + position;
+}
+
+static __inline unsigned int get_buddy(unsigned int level, unsigned int position)
+{
+	return (1U << level) - 1 + (position ^ 1);
+}
+
+static __inline unsigned int get_parent(unsigned int level, unsigned int position)
+{
+	return (1U << (level - 1)) - 1 + (position >> 1);
+}
+
+static __inline unsigned int get_left_child(unsigned int level, unsigned int position)
+{
+	return (2U << level) - 1 + (position << 1);
+}
+
+static __inline unsigned int get_right_child(unsigned int level, unsigned int position)
+{
+	return (2U << level) + (position << 1);
+}
+
+static __inline unsigned int get_position(U32 base, unsigned int power, void *addr, unsigned int level)
+{
+	return ((unsigned int)addr - base) >> (power - level);
+}
+
+static __inline void *get_address(U32 base, unsigned int power, unsigned int level, unsigned int position)
+{
+	return (void *)(base + (position << (power - level)));
+}
+
+/* upper half of the block at level starting at start_addr */
+static __inline void *split_addr(unsigned int power, unsigned int level, void *start_addr)
+{
+	return (void *)((unsigned int)start_addr + (get_block_size(power, level) >> 1));
+}
+
+/* bit of a node within its byte of the tree, MSB first */
+static __inline unsigned int get_offset(unsigned int index)
+{
+	return 7 - (index & 7);
+}
+
+static __inline BOOL is_allocated(U8 *bit_tree, unsigned int index)
+{
+	return (bit_tree[index >> 3] >> get_offset(index)) & 1U;
+}
+
+static __inline void clear_bit(U8 *bit_tree, unsigned int index)
+{
+	bit_tree[index >> 3] &= ~(1U << get_offset(index));
+}
+
+static __inline void set_bit(U8 *bit_tree, unsigned int index)
+{
+	bit_tree[index >> 3] |= (1U << get_offset(index));
+}
+
+#endif // ! BTREE_H_
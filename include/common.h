@@ -94,7 +94,7 @@
 #define EDF                 12      /* earliest-deadline-first scheduling */
 
 
-#define MAX_TASKS           10      /* maximum number of tasks in the system */
+#define MAX_TASKS           10      /* maximum number of tasks in the system, at most TID_TIMER */
 #define KERN_STACK_SIZE     0x400   /* task kernel stack size in bytes */
 #define PROC_STACK_SIZE     0x200   /* minimum task user stack size in bytes */
 #define TID_NULL            0x0     /* reserved Task ID for the null task */
@@ -114,11 +114,11 @@
 #define PRIO_RT             PRIO_RT_LB
                                     /* real-time task priority level */
                                     /* real-time task priority level upper bound */
-/* Non-Real-time Task Priorities. */
+/* Non-Real-time Task Priorities, any value from HIGH to LOWEST is a level. */
 #define HIGH                0x80
-#define MEDIUM              0x81
-#define LOW                 0x82
-#define LOWEST              0x83
+#define MEDIUM              (HIGH + PRIO_LEVELS / 4)
+#define LOW                 (HIGH + PRIO_LEVELS / 2)
+#define LOWEST              (HIGH + PRIO_LEVELS - 1)
 #define PRIO_NULL           0xFF    /* hidden priority for the null task */
 
 /* Task States */
@@ -255,6 +255,10 @@ typedef struct rtx_task_info
     U8          prio;               /**< execution priority                 */
     U8          priv;               /**< = 0 unprivileged, =1 privileged    */   
     U8          state;              /**< task state                         */
+    U32         max_u_stack_used;   /**< user stack high-water mark, bytes  */
+    U32         max_k_stack_used;   /**< kernel stack high-water mark, bytes*/
+    U32         heap_used;          /**< bytes of user heap the task owns   */
+    U32         heap_blocks;        /**< user heap blocks the task owns     */
 } RTX_TASK_INFO;
 
 /* message header struct */
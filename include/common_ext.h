@@ -58,17 +58,59 @@
  #define MEM1_HEIGHT 		(MEM1_POWER - MIN_POWER)
  #define MEM2_HEIGHT 		(MEM2_POWER - MIN_POWER)
  
- #define MEM1_NODES			255
- #define MEM2_NODES			2047
+ #define MEM1_BLOCKS		(1 << MEM1_HEIGHT)	/* min blocks per pool */
+ #define MEM2_BLOCKS		(1 << MEM2_HEIGHT)
+ 
+ #define TLSF				6	/* two-level segregated fit, RTX_SYS_INFO.mem_algo */
+ #define STACK_POOL			7	/* size-exact top-down stack region, k_mpool_create only */
+ 
+ #define MEM1_NODES			((2 << MEM1_HEIGHT) - 1)	/* nodes in each pool's buddy tree */
+ #define MEM2_NODES			((2 << MEM2_HEIGHT) - 1)
  
  #define TREE1_INDICIES	(MEM1_NODES / 8 + 1)
  #define TREE2_INDICIES	(MEM2_NODES / 8 + 1)
+ 
+ #define NUM_MPOOLS			8	/* pool descriptors, the first MAX_MPOOLS are IRAM1 and IRAM2 */
+ #define MBX_POOL_SIZE		0	/* bytes of IRAM2 kept as a mailbox sub-pool, 0 to share IRAM2 */
+ #define STACK_POOL_SIZE	0	/* bytes of IRAM2 kept as a STACK_POOL for task stacks, 0 to share IRAM2 */
+ 
+ #define MAG_CLASSES		3	/* per-task caches of 32, 64 and 128 byte IRAM1 blocks */
+ #define MAG_DEPTH			8	/* blocks a task may cache per class, 0 disables the caches */
+ #define MAG_BATCH			4	/* blocks moved per magazine refill or spill */
+ 
+ #define LAZY_WATERMARK		0	/* freed blocks a buddy pool may leave uncoalesced, 0 coalesces eagerly */
+ #define UHEAP_CHUNK_SIZE	256	/* bytes librtx's uheap takes from the kernel heap at a time */
+ #define PREZERO_BLOCKS		4	/* free IRAM1 min blocks the null task zeroes per mem_idle call, 0 disables */
+ #define MEM_TRACE			0	/* 1 prints every alloc/free as an "mt" line for RTX-App/host/mem_replay */
+
+ #define STACK_PAINT		0xA5A5A5A5	/* fill of stack words a task has never touched */
+ #define SHARED_K_STACK		0	/* 1 runs every task's kernel calls on one MSP stack instead of one each */
+ #define TCB_ON_DEMAND		0	/* 1 takes a task's TCB from IRAM2 while it exists instead of g_tcbs[] */
+ #define TICKLESS_IDLE		0	/* 1 stops the 500 us tick while only the null task can run */
+
+ #define STATIC_ALLOC		0	/* 1 plans every stack, mailbox and kernel buffer at boot; user heap calls then fail with EPERM */
+ #define STATIC_STACK_SIZE	0x200	/* user stack kept for each TID no boot task uses, 0 for none */
+ #define STATIC_MBX_SIZE	0x100	/* mailbox kept for each TID STATIC_MBX_PLAN leaves out */
+ #define STATIC_MBX_PLAN	{ [TID_WCLCK] = 0x80, [TID_CON] = CON_MBX_SIZE, [TID_KCD] = KCD_MBX_SIZE }
+ #define STATIC_BUF_SIZE	0x80	/* size of the IRAM2 buffers k_mpool_alloc hands out once sealed */
+ #define STATIC_BUF_COUNT	16	/* number of those buffers */
 
  #define PRIO_OFFSET    0x80
+ #define PRIO_LEVELS    32	/* non-RT priority levels from HIGH to LOWEST, at most 32 */
+ #define PS_PERIOD      20	/* RM_PS polling server period in ticks, its rate-monotonic priority */
+ #define PS_BUDGET      4	/* ticks of non-RT work the server runs per period */
  #define INVOLUNTARY    0
  #define VOLUNTARY      1
 
  #define USEC_IN_SEC    1000000
+ 
+ #define SVC_MEM_STATS  0x30
+ #define SVC_MEM_REALLOC 0x31
+ #define SVC_MEM_ALLOC_N 0x32
+ #define SVC_MEM_DEALLOC_N 0x33
+ #define SVC_MEM_IDLE   0x34
+ #define SVC_MEM_CALLOC 0x35
+ #define SVC_TSK_IDLE   0x36
 /*
  *===========================================================================
  *                             TYPEDEFS
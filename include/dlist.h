@@ -1,3 +1,6 @@
+#ifndef DLIST_H_
+#define DLIST_H_
+
 #include "common.h"
 
 typedef struct dnode
@@ -19,3 +22,5 @@ DNODE* pop_front(DLIST *dlist);
 DNODE* pop_back(DLIST *dlist);
 void remove(DLIST *dlist, DNODE *node);
 void insert_before(DLIST *dlist, DNODE *new_node, DNODE *node);
+
+#endif // ! DLIST_H_
@@ -5,7 +5,7 @@ typedef struct mailbox
     U8 *buf_start, *buf_end;
     U8 *head, *tail;
     size_t space;
-    DLIST wait_list[4];
+    DLIST wait_list;        /* senders blocked on a full mailbox, highest priority first */
 		DLIST rt_wait_list;
 } MAILBOX;
 
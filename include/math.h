@@ -1,5 +1,12 @@
 #include "common.h"
 
+/* count leading zeros, maps to the single-cycle CLZ instruction on the Cortex-M3 */
+#ifdef __ARMCC_VERSION
+#define clz(x)      __clz(x)
+#else
+#define clz(x)      ((x) == 0 ? 32 : __builtin_clz(x))
+#endif
+
 unsigned int log2_ceil(unsigned int input);
 unsigned int upow(unsigned int base, unsigned int exponent);
 U8 num_places(unsigned int number);
@@ -0,0 +1,25 @@
+#ifndef MEM_STATS_H_
+#define MEM_STATS_H_
+
+#include "common.h"
+
+#define MEM_ORDERS      (MEM2_HEIGHT + 1)   /* free block orders reported by mem_stats */
+
+/**
+ * @brief   memory pool statistics filled by mem_stats
+ * @note    a free block of order n holds at least MIN_BLK_SIZE << n bytes
+ */
+typedef struct mem_stats
+{
+    U32 in_use;                     /**< bytes handed out, including rounding and headers */
+    U32 peak;                       /**< highest in_use since the pool was created        */
+    U32 free;                       /**< bytes in free blocks                             */
+    U32 largest_free;               /**< size of the largest free block                   */
+    U32 free_blocks[MEM_ORDERS];    /**< number of free blocks of each order              */
+    U32 num_alloc;                  /**< allocations that succeeded                       */
+    U32 num_free;                   /**< deallocations that succeeded                     */
+    U32 num_failed;                 /**< allocations that returned NULL                   */
+    U32 frag;                       /**< 100 * (1 - largest_free / free), 0 if none free  */
+} MEM_STATS;
+
+#endif // ! MEM_STATS_H_
@@ -39,12 +39,22 @@
  * @see         common.h
  *****************************************************************************/
  
+ #include "mem_stats.h"
+
  /*
  *===========================================================================
  *                            FUNCTION PROTOTYPES
  *===========================================================================
  */
  
+__svc(SVC_MEM_STATS)    int     mem_stats(mpool_t mpid, MEM_STATS *out);
+__svc(SVC_MEM_REALLOC)  void   *mem_realloc(void *ptr, size_t size);
+__svc(SVC_MEM_ALLOC_N)  int     mem_alloc_n(size_t size, size_t count, void **out);
+__svc(SVC_MEM_DEALLOC_N) int    mem_dealloc_n(void **ptrs, size_t count);
+__svc(SVC_MEM_IDLE)     int     mem_idle(void);
+__svc(SVC_MEM_CALLOC)   void   *mem_calloc(size_t num, size_t size);
+__svc(SVC_TSK_IDLE)     int     tsk_idle(void);
+ 
  /*
  *===========================================================================
  *                             END OF FILE
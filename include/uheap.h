@@ -0,0 +1,37 @@
+#ifndef UHEAP_H_
+#define UHEAP_H_
+
+#include "common.h"
+#include "dlist.h"
+#include "lpc1768_mem.h"
+
+/*
+ * User-space heap for small objects. Objects of up to UHEAP_MAX_OBJ bytes
+ * are carved out of UHEAP_CHUNK_SIZE byte chunks taken with mem_alloc, so
+ * only a new chunk, or a chunk going back once it is empty, traps into the
+ * kernel. Larger requests go straight to mem_alloc.
+ *
+ * Chunks are aligned to UHEAP_CHUNK_SIZE and the heap keeps a bit for each
+ * such slot of RAM1 it has a chunk in, so uheap_free finds an object's chunk
+ * by masking its address.
+ *
+ * There is no locking: a UHEAP belongs to one task. Chunks are ordinary
+ * heap blocks of that task, so they are reclaimed when it exits.
+ */
+#define UHEAP_MIN_OBJ   8
+#define UHEAP_CLASSES   4       /* 8, 16, 32 and 64 byte objects */
+#define UHEAP_MAX_OBJ   (UHEAP_MIN_OBJ << (UHEAP_CLASSES - 1))
+#define UHEAP_SLOTS     (RAM1_SIZE / UHEAP_CHUNK_SIZE)
+
+typedef struct uheap
+{
+    DLIST chunks[UHEAP_CLASSES];    /* chunks of each class, those with free objects first */
+    U32   chunk_map[(UHEAP_SLOTS + 31) >> 5];  /* RAM1 slots holding one of the chunks */
+} UHEAP;
+
+void  uheap_init(UHEAP *heap);
+void *uheap_alloc(UHEAP *heap, size_t size);
+int   uheap_free(UHEAP *heap, void *ptr);
+void  uheap_destroy(UHEAP *heap);
+
+#endif // ! UHEAP_H_